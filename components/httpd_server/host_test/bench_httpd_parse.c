@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "httpd_host.h"
+
+// requests as sent by a browser loading the dashboard, same as scripts/bench_http_requests.py
+static const char *RECORDED_REQUESTS[] = {
+    "GET / HTTP/1.1\r\n"
+    "Host: 192.168.4.1\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "\r\n",
+
+    "GET /css/index.css HTTP/1.1\r\n"
+    "Host: 192.168.4.1\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Referer: http://192.168.4.1/\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "\r\n",
+
+    "GET /js/App.js HTTP/1.1\r\n"
+    "Host: 192.168.4.1\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+    "Accept: */*\r\n"
+    "Referer: http://192.168.4.1/\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "If-None-Match: 0000000000000000000000000000000000000000\r\n"
+    "\r\n",
+
+    "GET /favicon.ico HTTP/1.1\r\n"
+    "Host: 192.168.4.1\r\n"
+    "Connection: keep-alive\r\n"
+    "Accept: image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;q=0.8\r\n"
+    "Referer: http://192.168.4.1/\r\n"
+    "\r\n",
+
+    "POST /api/v1/led?index=0 HTTP/1.1\r\n"
+    "Host: 192.168.4.1\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Content-Length: 16\r\n"
+    "\r\n"
+    "0123456789abcdef",
+};
+
+// chunk sizes that exercise the 128 byte parser block boundaries, 0 passes everything in one recv
+static const size_t CHUNK_SIZES[] = { 0, 1, 7, 127, 128, 129, 1460 };
+
+static double get_time_s(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec*1e-9;
+}
+
+int main(int argc, char **argv) {
+    // requests per keep-alive connection and how many connections to run per chunk size
+    const size_t total_repeats = (argc > 1) ? strtoul(argv[1], NULL, 10) : 32;
+    const size_t total_connections = (argc > 2) ? strtoul(argv[2], NULL, 10) : 2000;
+
+    const size_t total_recorded = sizeof(RECORDED_REQUESTS)/sizeof(RECORDED_REQUESTS[0]);
+    size_t stream_size = 0;
+    for (size_t i = 0; i < total_recorded; i++) stream_size += strlen(RECORDED_REQUESTS[i]);
+    stream_size *= total_repeats;
+    uint8_t *stream = malloc(stream_size);
+    if (stream == NULL) return 1;
+    size_t offset = 0;
+    for (size_t repeat = 0; repeat < total_repeats; repeat++) {
+        for (size_t i = 0; i < total_recorded; i++) {
+            const size_t length = strlen(RECORDED_REQUESTS[i]);
+            memcpy(&stream[offset], RECORDED_REQUESTS[i], length);
+            offset += length;
+        }
+    }
+    const size_t expected_requests = total_repeats*total_recorded;
+
+    httpd_host_init();
+    int total_failed = 0;
+    printf("%6s %12s %12s %10s\n", "chunk", "requests/s", "ns/request", "MB/s");
+    for (size_t i = 0; i < sizeof(CHUNK_SIZES)/sizeof(CHUNK_SIZES[0]); i++) {
+        const size_t chunk_size = CHUNK_SIZES[i];
+        size_t total_requests = 0;
+        const double start = get_time_s();
+        for (size_t connection = 0; connection < total_connections; connection++) {
+            const struct HttpdHostResult result = httpd_host_process(stream, stream_size, chunk_size);
+            if (result.total_requests != expected_requests || result.is_closed_early) {
+                fprintf(stderr, "[ERROR]: chunk=%zu parsed %zu of %zu requests\n", chunk_size, result.total_requests, expected_requests);
+                total_failed++;
+                break;
+            }
+            total_requests += result.total_requests;
+        }
+        const double elapsed = get_time_s() - start;
+        const double total_bytes = (double)stream_size*(double)total_connections;
+        printf("%6zu %12.0f %12.1f %10.1f\n", chunk_size, total_requests/elapsed, elapsed*1e9/total_requests, total_bytes/elapsed/1e6);
+    }
+    httpd_host_deinit();
+    free(stream);
+    return (total_failed > 0) ? 1 : 0;
+}
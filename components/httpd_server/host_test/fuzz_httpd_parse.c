@@ -0,0 +1,39 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "httpd_host.h"
+
+// the first byte picks how many bytes each recv returns so block boundaries land everywhere
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    static int is_initialised = 0;
+    if (!is_initialised) {
+        httpd_host_init();
+        is_initialised = 1;
+    }
+    if (size == 0) return 0;
+    const size_t chunk_size = data[0];
+    httpd_host_process(&data[1], size-1, chunk_size);
+    return 0;
+}
+
+#ifdef HTTPD_HOST_FUZZ_REPLAY
+// without libFuzzer the target replays the given inputs, e.g. crashes found on another machine
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        FILE *fp = fopen(argv[i], "rb");
+        if (fp == NULL) {
+            fprintf(stderr, "[ERROR]: failed to open '%s'\n", argv[i]);
+            return 1;
+        }
+        fseek(fp, 0, SEEK_END);
+        const long size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        uint8_t *data = malloc((size > 0) ? size : 1);
+        const size_t total_read = fread(data, 1, size, fp);
+        fclose(fp);
+        LLVMFuzzerTestOneInput(data, total_read);
+        free(data);
+        printf("%s: ok\n", argv[i]);
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,180 @@
+#include "httpd_host.h"
+#include <stdlib.h>
+#include <string.h>
+#include <esp_http_server.h>
+#include "esp_httpd_priv.h"
+
+// the parser only accepts calls from the server task, any handle will do as long as it is the same
+static int g_task;
+static struct httpd_data* g_server = NULL;
+static struct sock_db g_session;
+
+struct HttpdHostInput {
+    const uint8_t* data;
+    size_t size;
+    size_t offset;
+    size_t chunk_size;
+};
+static struct HttpdHostInput g_input;
+static size_t g_sent_bytes = 0;
+static int g_is_closed = 0;
+
+ESP_EVENT_DEFINE_BASE(ESP_HTTP_SERVER_EVENT);
+
+// everything httpd_parse.c, httpd_txrx.c and httpd_uri.c use from the rest of the server and the SDK
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return (TaskHandle_t)&g_task;
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return 0;
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    return "host error";
+}
+
+__attribute__((weak)) size_t strlcpy(char *dst, const char *src, size_t size) {
+    const size_t length = strlen(src);
+    if (size > 0) {
+        const size_t total_copied = (length < size) ? length : size-1;
+        memcpy(dst, src, total_copied);
+        dst[total_copied] = '\0';
+    }
+    return length;
+}
+
+void esp_http_server_dispatch_event(int32_t event_id, const void* event_data, size_t event_data_size) {}
+
+struct sock_db *httpd_sess_get(struct httpd_data *hd, int sockfd) {
+    return (sockfd == g_session.fd) ? &g_session : NULL;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+    g_is_closed = 1;
+    return ESP_OK;
+}
+
+void httpd_sess_free_ctx(void **ctx, httpd_free_ctx_fn_t free_fn) {
+    if ((!ctx) || (!*ctx)) return;
+    if (free_fn) {
+        free_fn(*ctx);
+    } else {
+        free(*ctx);
+    }
+    *ctx = NULL;
+}
+
+// no websocket handlers are registered so sessions are never upgraded
+esp_err_t httpd_ws_respond_server_handshake(httpd_req_t *req, const char *supported_subprotocol) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t httpd_ws_get_frame_type(httpd_req_t *req) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+static int host_recv(httpd_handle_t hd, int sockfd, char *buf, size_t buf_len, int flags) {
+    size_t length = g_input.size - g_input.offset;
+    if (length > buf_len) length = buf_len;
+    if (g_input.chunk_size > 0 && length > g_input.chunk_size) length = g_input.chunk_size;
+    memcpy(buf, &g_input.data[g_input.offset], length);
+    g_input.offset += length;
+    // 0 once the input is used up reads as the client closing the connection
+    return (int)length;
+}
+
+static int host_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags) {
+    g_sent_bytes += buf_len;
+    return (int)buf_len;
+}
+
+// touches the parts of the request a real handler reads and replies with a small body
+static esp_err_t handle_request(httpd_req_t *request) {
+    char value[64];
+    const size_t host_length = httpd_req_get_hdr_value_len(request, "Host");
+    if (host_length > 0) httpd_req_get_hdr_value_str(request, "Host", value, sizeof(value));
+    if (httpd_req_get_url_query_len(request) > 0) httpd_req_get_url_query_str(request, value, sizeof(value));
+
+    size_t remaining = request->content_len;
+    while (remaining > 0) {
+        const int received = httpd_req_recv(request, value, (remaining < sizeof(value)) ? remaining : sizeof(value));
+        if (received <= 0) return ESP_FAIL;
+        remaining -= received;
+    }
+    return httpd_resp_send(request, "ok", HTTPD_RESP_USE_STRLEN);
+}
+
+void httpd_host_init(void) {
+    assert(g_server == NULL);
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    // like init_server() in main/main.c but without a request limit so a whole input stays on one connection
+    config.max_open_sockets = 1;
+    config.lru_purge_enable = true;
+    config.http_keep_alive_timeout = 5;
+    config.http_keep_alive_max_requests = 0;
+    config.uri_match_fn = httpd_uri_match_wildcard;
+
+    struct httpd_data* hd = calloc(1, sizeof(struct httpd_data));
+    assert(hd != NULL);
+    hd->hd_calls = calloc(config.max_uri_handlers, sizeof(httpd_uri_t *));
+    hd->hd_req_aux.resp_hdrs = calloc(config.max_resp_headers, sizeof(struct resp_hdr));
+    hd->err_handler_fns = calloc(HTTPD_ERR_CODE_MAX, sizeof(httpd_err_handler_func_t));
+    assert(hd->hd_calls != NULL && hd->hd_req_aux.resp_hdrs != NULL && hd->err_handler_fns != NULL);
+    hd->config = config;
+    hd->hd_td.handle = xTaskGetCurrentTaskHandle();
+    g_server = hd;
+
+    const httpd_method_t methods[] = { HTTP_GET, HTTP_POST, HTTP_PUT };
+    for (size_t i = 0; i < sizeof(methods)/sizeof(methods[0]); i++) {
+        httpd_uri_t uri = {
+            .uri = "/*",
+            .method = methods[i],
+            .handler = handle_request,
+            .user_ctx = NULL,
+        };
+        const esp_err_t status = httpd_register_uri_handler((httpd_handle_t)hd, &uri);
+        assert(status == ESP_OK);
+        (void)status;
+    }
+}
+
+void httpd_host_deinit(void) {
+    assert(g_server != NULL);
+    httpd_unregister_all_uri_handlers(g_server);
+    free(g_server->err_handler_fns);
+    free(g_server->hd_req_aux.resp_hdrs);
+    free(g_server->hd_calls);
+    free(g_server);
+    g_server = NULL;
+}
+
+struct HttpdHostResult httpd_host_process(const uint8_t *data, size_t size, size_t chunk_size) {
+    assert(g_server != NULL);
+    g_input.data = data;
+    g_input.size = size;
+    g_input.offset = 0;
+    g_input.chunk_size = chunk_size;
+    g_sent_bytes = 0;
+    g_is_closed = 0;
+
+    memset(&g_session, 0, sizeof(g_session));
+    g_session.fd = 1;
+    g_session.handle = (httpd_handle_t)g_server;
+    g_session.recv_fn = host_recv;
+    g_session.send_fn = host_send;
+
+    // same steps as httpd_sess_process() for every request on the connection
+    struct HttpdHostResult result = { 0 };
+    while (g_input.offset < g_input.size || g_session.pending_len > 0) {
+        if (httpd_req_new(g_server, &g_session) != ESP_OK) break;
+        if (httpd_req_delete(g_server) != ESP_OK) break;
+        result.total_requests++;
+        if (g_session.close_after_resp || g_is_closed) break;
+    }
+    httpd_sess_free_ctx(&g_session.ctx, g_session.free_ctx);
+    result.total_sent_bytes = g_sent_bytes;
+    result.is_closed_early = (g_input.offset < g_input.size || g_session.pending_len > 0);
+    return result;
+}
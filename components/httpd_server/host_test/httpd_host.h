@@ -0,0 +1,22 @@
+#ifndef __HTTPD_HOST_H__
+#define __HTTPD_HOST_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// runs httpd_parse.c on the host with one session whose recv_fn reads from memory
+// the recv_fn returns at most chunk_size bytes per call like a TCP segment would, 0 means no limit
+
+struct HttpdHostResult {
+    size_t total_requests;
+    size_t total_sent_bytes;
+    // the server closed the session before all input was read
+    int is_closed_early;
+};
+
+void httpd_host_init(void);
+void httpd_host_deinit(void);
+// feeds the data to the parser as one keep-alive connection until it is read or the server closes it
+struct HttpdHostResult httpd_host_process(const uint8_t *data, size_t size, size_t chunk_size);
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+#include <stdio.h>
+#include <inttypes.h>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+// logging costs more than parsing on the host so it is compiled out unless HTTPD_HOST_LOG is set
+#ifdef HTTPD_HOST_LOG
+#define HTTPD_HOST_LOG_ENABLED 1
+#else
+#define HTTPD_HOST_LOG_ENABLED 0
+#endif
+#define ESP_HOST_LOG(level, tag, format, ...) do { \
+        if (HTTPD_HOST_LOG_ENABLED) fprintf(stderr, "%c (%s) " format "\n", level, tag, ##__VA_ARGS__); \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) ESP_HOST_LOG('E', tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_HOST_LOG('W', tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_HOST_LOG('I', tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_HOST_LOG('D', tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_HOST_LOG('V', tag, format, ##__VA_ARGS__)
+#define ESP_LOG_BUFFER_HEX_LEVEL(tag, buffer, length, level) do { (void)(buffer); (void)(length); } while (0)
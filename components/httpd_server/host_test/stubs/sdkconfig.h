@@ -0,0 +1,9 @@
+// values of the httpd options in the project's sdkconfig
+#pragma once
+#define CONFIG_HTTPD_MAX_REQ_HDR_LEN 1024
+#define CONFIG_HTTPD_MAX_URI_LEN 512
+#define CONFIG_HTTPD_ERR_RESP_NO_DELAY 1
+#define CONFIG_HTTPD_PURGE_BUF_LEN 32
+#define CONFIG_HTTPD_WS_SUPPORT 1
+#define CONFIG_HTTPD_SHED_RETRY_AFTER 2
+#define CONFIG_LWIP_MAX_SOCKETS 11
@@ -72,6 +72,9 @@ initializer that should be kept in sync
         .keep_alive_idle = 0,                           \
         .keep_alive_interval = 0,                       \
         .keep_alive_count = 0,                          \
+        .http_keep_alive_timeout = 0,                   \
+        .http_keep_alive_max_requests = 0,              \
+        .shed_when_full = false,                        \
         .open_fn = NULL,                                \
         .close_fn = NULL,                               \
         .uri_match_fn = NULL                            \
@@ -222,6 +225,33 @@ typedef struct httpd_config {
     int keep_alive_idle;    /*!< Keep-alive idle time. Default is 5 (second) */
     int keep_alive_interval;/*!< Keep-alive interval time. Default is 5 (second) */
     int keep_alive_count;   /*!< Keep-alive packet retry send count. Default is 3 counts */
+
+    /**
+     * HTTP persistent connection management.
+     *
+     * Responses carry "Connection: keep-alive" unless the client asked for
+     * "Connection: close" (or used HTTP/1.0 without keep-alive), or the session
+     * reached http_keep_alive_max_requests, in which case "Connection: close" is
+     * sent and the session is closed once the response is complete.
+     *
+     * HTTP sessions which stay idle for http_keep_alive_timeout seconds are closed
+     * to free up their socket. WebSocket sessions are not affected by either limit.
+     */
+    uint16_t http_keep_alive_timeout;       /*!< Idle timeout for HTTP sessions (in seconds), 0 to disable */
+    uint16_t http_keep_alive_max_requests;  /*!< Max requests served per HTTP session, 0 for unlimited */
+
+    /**
+     * Overload shedding.
+     *
+     * When every session is in use and none can be LRU purged, new clients are
+     * accepted, sent a "503 Service Unavailable" response with a Retry-After
+     * header (see CONFIG_HTTPD_SHED_RETRY_AFTER) and closed right away, rather
+     * than being left waiting in the listen backlog until they time out.
+     *
+     * This needs one more LWIP socket than max_open_sockets + 3.
+     */
+    bool shed_when_full;
+
     /**
      * Custom session opening callback.
      *
@@ -1135,6 +1165,89 @@ esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len);
  */
 esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len);
 
+/**
+ * @brief   API to start a response whose length is known up front
+ *
+ * Sends the status line and headers with a Content-Length of content_len.
+ * The body is then sent as is with httpd_resp_send_stream_data(), without
+ * the per chunk framing of httpd_resp_send_chunk(), and the response is
+ * finished with httpd_resp_send_stream_end().
+ *
+ * @note
+ *  - This API is supposed to be called only from the context of
+ *    a URI handler where httpd_req_t* request pointer is valid.
+ *  - Status, content type and additional headers have to be set
+ *    before calling this API.
+ *  - Once this API is called, all request headers are purged, so
+ *    request headers need be copied into separate buffers if
+ *    they are required later.
+ *
+ * @param[in] r             The request being responded to
+ * @param[in] content_len   Total length of the body that will be sent
+ *
+ * @return
+ *  - ESP_OK : On successfully sending the headers
+ *  - ESP_ERR_INVALID_ARG       : Null request pointer
+ *  - ESP_ERR_INVALID_STATE     : A response was already started
+ *  - ESP_ERR_HTTPD_RESP_HDR    : Essential headers are too large for internal buffer
+ *  - ESP_ERR_HTTPD_RESP_SEND   : Error in raw send
+ *  - ESP_ERR_HTTPD_INVALID_REQ : Invalid request pointer
+ */
+esp_err_t httpd_resp_send_stream_begin(httpd_req_t *r, size_t content_len);
+
+/**
+ * @brief   API to send the next part of a response started with httpd_resp_send_stream_begin()
+ *
+ * @param[in] r         The request being responded to
+ * @param[in] buf       Buffer from where the content is to be fetched
+ * @param[in] buf_len   Length of the buffer
+ *
+ * @return
+ *  - ESP_OK : On successfully sending the data
+ *  - ESP_ERR_INVALID_ARG       : Null request pointer or buffer
+ *  - ESP_ERR_INVALID_STATE     : No stream was started
+ *  - ESP_ERR_INVALID_SIZE      : More data than the announced Content-Length
+ *  - ESP_ERR_HTTPD_RESP_SEND   : Error in raw send
+ *  - ESP_ERR_HTTPD_INVALID_REQ : Invalid request pointer
+ */
+esp_err_t httpd_resp_send_stream_data(httpd_req_t *r, const char *buf, size_t buf_len);
+
+/**
+ * @brief   API to send as much of the next part of a stream as fits without blocking
+ *
+ * Same as httpd_resp_send_stream_data() but only copies what the socket's
+ * send buffer can take right now, so the caller can prepare the next part
+ * while the rest is still waiting to go out.
+ *
+ * @param[in] r         The request being responded to
+ * @param[in] buf       Buffer from where the content is to be fetched
+ * @param[in] buf_len   Length of the buffer
+ *
+ * @return
+ *  - Bytes : Number of bytes taken, 0 if the send buffer is full
+ *  - HTTPD_SOCK_ERR_INVALID : Invalid arguments, no stream was started or more data than announced
+ *  - HTTPD_SOCK_ERR_FAIL    : Unrecoverable error while calling socket send()
+ */
+int httpd_resp_try_send_stream_data(httpd_req_t *r, const char *buf, size_t buf_len);
+
+/**
+ * @brief   API to finish a response started with httpd_resp_send_stream_begin()
+ *
+ * @note    If less than the announced Content-Length was sent, the
+ *          connection is closed after the handler returns since the
+ *          client can't tell where the next response starts.
+ *
+ * @param[in] r         The request being responded to
+ *
+ * @return
+ *  - ESP_OK : The whole body was sent
+ *  - ESP_ERR_INVALID_ARG       : Null request pointer
+ *  - ESP_ERR_INVALID_STATE     : No stream was started
+ *  - ESP_ERR_INVALID_SIZE      : Body is shorter than the announced Content-Length
+ *  - ESP_ERR_HTTPD_INVALID_REQ : Invalid request pointer
+ */
+esp_err_t httpd_resp_send_stream_end(httpd_req_t *r);
+
 /**
  * @brief   API to send a complete string as HTTP response.
  *
@@ -1265,6 +1378,35 @@ esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type);
  */
 esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value);
 
+/**
+ * @brief   API to append a block of pre-rendered header lines
+ *
+ * This API sets header lines that were formatted ahead of time, e.g.
+ * "ETag: abc\r\nCache-Control: no-cache\r\n". The block is packed
+ * behind the connection headers as is, so no per field formatting is
+ * done when the response is sent. Headers added with httpd_resp_set_hdr()
+ * follow the block.
+ *
+ * @note
+ *  - This API is supposed to be called only from the context of
+ *    a URI handler where httpd_req_t* request pointer is valid.
+ *  - Every line in the block must end with "\r\n", the blank line
+ *    ending the header section is added by the send APIs.
+ *  - Only one block is kept per response, setting another replaces it.
+ *  - Make sure that the lifetime of the block is valid till
+ *    send function is called.
+ *
+ * @param[in] r         The request being responded to
+ * @param[in] block     Pre-rendered header lines
+ * @param[in] block_len Length of the block in bytes
+ *
+ * @return
+ *  - ESP_OK : On successfully setting the block
+ *  - ESP_ERR_INVALID_ARG : Null arguments
+ *  - ESP_ERR_HTTPD_INVALID_REQ : Invalid request pointer
+ */
+esp_err_t httpd_resp_set_hdr_block(httpd_req_t *r, const char *block, size_t block_len);
+
 /**
  * @brief   For sending out error code in response to HTTP request.
  *
@@ -1590,6 +1732,34 @@ esp_err_t httpd_sess_update_lru_counter(httpd_handle_t handle, int sockfd);
  */
 esp_err_t httpd_get_client_list(httpd_handle_t handle, size_t *fds, int *client_fds);
 
+/**
+ * @brief   Connection statistics of a server instance
+ *
+ * Counters are updated by the server task and wrap around on overflow.
+ */
+typedef struct httpd_stats {
+    uint32_t accepted_conns;    /*!< Connections accepted into a session */
+    uint32_t shed_conns;        /*!< Connections answered with 503 because no session could be freed */
+    uint32_t lru_purged_conns;  /*!< Sessions closed to make room for a new connection */
+    uint32_t idle_closed_conns; /*!< HTTP sessions closed by the keep-alive idle timeout */
+} httpd_stats_t;
+
+/**
+ * @brief   Returns a snapshot of the connection statistics
+ *
+ * @note    This may be called from any task. Counters are read without
+ *          locking, so a snapshot taken while the server is busy may mix
+ *          values from consecutive updates.
+ *
+ * @param[in]  handle   Handle to server returned by httpd_start
+ * @param[out] stats    Statistics to fill in
+ *
+ * @return
+ *  - ESP_OK              : Statistics copied
+ *  - ESP_ERR_INVALID_ARG : Null arguments
+ */
+esp_err_t httpd_get_stats(httpd_handle_t handle, httpd_stats_t *stats);
+
 /** End of Session
  * @}
  */
@@ -1700,6 +1870,48 @@ typedef void (*transfer_complete_cb)(esp_err_t err, int socket, void *arg);
  */
 esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len);
 
+/**
+ * @brief Callback for frames received with httpd_ws_recv_frames()
+ *
+ * @param[in]   req     Current request
+ * @param[in]   frame   Received frame, the payload is borrowed and only valid during the call
+ * @param[in]   arg     User argument passed to httpd_ws_recv_frames()
+ * @return
+ *  - ESP_OK    : Continue with the next buffered frame
+ *  - other     : Stop and return this error from httpd_ws_recv_frames()
+ */
+typedef esp_err_t (*httpd_ws_frame_cb_t)(httpd_req_t *req, httpd_ws_frame_t *frame, void *arg);
+
+/**
+ * @brief Receive every WebSocket frame that is already buffered and pass each one to a callback
+ *
+ * Frames are decoded in place inside the request's scratch buffer so the
+ * payload is not copied into a user buffer. This should be called by the
+ * handler instead of httpd_ws_recv_frame().
+ *
+ * @note    Control frames are passed to the callback as well, so the URI
+ *          handler should have handle_ws_control_frames set.
+ * @note    The whole frame has to fit in the scratch buffer
+ *          (CONFIG_HTTPD_MAX_REQ_HDR_LEN or CONFIG_HTTPD_MAX_URI_LEN
+ *          bytes, whichever is larger).
+ * @note    A trailing incomplete frame is kept in the session's pending
+ *          data so it is handled once the rest arrives, unless it is too
+ *          large for it, in which case this blocks until it is complete.
+ *          Nothing after a CLOSE frame is dispatched.
+ *
+ * @param[in]   req     Current request
+ * @param[in]   cb      Called for each frame in the order they were received
+ * @param[in]   arg     User argument for the callback
+ * @return
+ *  - ESP_OK                    : Frames dispatched
+ *  - ESP_FAIL                  : Socket errors occurs
+ *  - ESP_ERR_INVALID_SIZE      : Frame doesn't fit in the scratch buffer
+ *  - ESP_ERR_INVALID_STATE     : Handshake not done or frame not masked
+ *  - ESP_ERR_INVALID_ARG       : Argument is invalid (null or non-WebSocket)
+ *  - other                     : Error returned by the callback
+ */
+esp_err_t httpd_ws_recv_frames(httpd_req_t *req, httpd_ws_frame_cb_t cb, void *arg);
+
 /**
  * @brief Construct and send a WebSocket frame
  * @param[in]   req     Current request
@@ -73,6 +73,9 @@ struct sock_db {
     char pending_data[PARSER_BLOCK_SIZE];   /*!< Buffer for pending data to be received */
     size_t pending_len;                     /*!< Length of pending data to be received */
     bool for_async_req;                     /*!< If true, the socket will not be LRU purged */
+    uint32_t idle_since;                    /*!< Time (in ms) since the session finished its last request */
+    uint16_t req_count;                     /*!< Number of HTTP requests parsed on this session */
+    bool close_after_resp;                  /*!< Set when the response advertised "Connection: close" */
 #ifdef CONFIG_HTTPD_WS_SUPPORT
     bool ws_handshake_done;                 /*!< True if it has done WebSocket handshake (if this socket is a valid WS) */
     bool ws_close;                          /*!< Set to true to close the socket later (when WS Close frame received) */
@@ -93,6 +96,11 @@ struct httpd_req_aux {
     char           *status;                         /*!< HTTP response's status code */
     char           *content_type;                   /*!< HTTP response's content type */
     bool            first_chunk_sent;               /*!< Used to indicate if first chunk sent */
+    bool            stream_started;                 /*!< Headers of a fixed length stream were sent */
+    size_t          stream_remaining;               /*!< Body bytes left to send in the stream */
+    const char     *resp_hdr_block;                 /*!< Pre-rendered header lines of the response */
+    size_t          resp_hdr_block_len;             /*!< Length of the pre-rendered header lines */
+    bool            keep_alive;                     /*!< Client allows the connection to be reused after this request */
     unsigned        req_hdrs_count;                 /*!< Count of total headers in request packet */
     unsigned        resp_hdrs_count;                /*!< Count of additional headers in response packet */
     struct resp_hdr {
@@ -127,6 +135,8 @@ struct httpd_data {
     struct httpd_req hd_req;                /*!< The current HTTPD request */
     struct httpd_req_aux hd_req_aux;        /*!< Additional data about the HTTPD request kept unexposed */
     uint64_t lru_counter;                   /*!< LRU counter */
+    httpd_stats_t stats;                    /*!< Connection statistics */
+    bool ws_frames_pending;                 /*!< A WebSocket session has whole frames left in its pending data */
 
     /* Array of registered error handler functions */
     httpd_err_handler_func_t *err_handler_fns;
@@ -284,6 +294,44 @@ bool httpd_sess_pending(struct httpd_data *hd, struct sock_db *session);
  */
 esp_err_t httpd_sess_close_lru(struct httpd_data *hd);
 
+/**
+ * @brief   Checks if the session has been upgraded to a WebSocket
+ *
+ * @param[in] session Session
+ *
+ * @return True if session is a WebSocket
+ */
+bool httpd_sess_is_ws(struct sock_db *session);
+
+/**
+ * @brief   Returns the session that would be closed by httpd_sess_close_lru()
+ *
+ * Sessions with an async request in flight and WebSocket sessions are
+ * never purged, so this may return NULL even if the database is full.
+ *
+ * @param[in] hd  Server instance data
+ *
+ * @return
+ *  - +VE : Least recently used session that can be purged
+ *  - NULL: No session can be purged
+ */
+struct sock_db *httpd_sess_get_lru(struct httpd_data *hd);
+
+/**
+ * @brief   Closes HTTP sessions which have been idle for longer than
+ *          the configured keep-alive timeout
+ *
+ * WebSocket sessions and sessions with an async request in flight
+ * are left open.
+ *
+ * @param[in] hd  Server instance data
+ *
+ * @return
+ *  - +VE : Time (in ms) until the next idle session expires
+ *  - -1  : No session is waiting to expire or the timeout is disabled
+ */
+int httpd_sess_close_idle(struct httpd_data *hd);
+
 /**
  * @brief   Closes all sessions
  *
@@ -532,6 +580,16 @@ esp_err_t httpd_ws_respond_server_handshake(httpd_req_t *req, const char *suppor
  */
 esp_err_t httpd_ws_get_frame_type(httpd_req_t *req);
 
+/**
+ * @brief   Check if the pending data of a WebSocket session holds a whole frame
+ *
+ * @param[in] sd    Session to check
+ * @return
+ *  - true  : A complete frame can be handled without waiting for the socket
+ *  - false : No pending data or only part of a frame
+ */
+bool httpd_ws_frame_pending(struct sock_db *sd);
+
 /**
  * @brief   Trigger an httpd session close externally
  *
@@ -31,9 +31,21 @@ static const int DEFAULT_KEEP_ALIVE_IDLE = 5;
 static const int DEFAULT_KEEP_ALIVE_INTERVAL= 5;
 static const int DEFAULT_KEEP_ALIVE_COUNT= 3;
 
+#define HTTPD_STR_(x) #x
+#define HTTPD_STR(x)  HTTPD_STR_(x)
+
+/* Sent as is to connections that are shed, so turning a client away
+ * takes a single send and no formatting */
+static const char httpd_shed_resp[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                      "Retry-After: " HTTPD_STR(CONFIG_HTTPD_SHED_RETRY_AFTER) "\r\n"
+                                      "Content-Length: 0\r\n"
+                                      "Connection: close\r\n"
+                                      "\r\n";
+
 typedef struct {
     fd_set *fdset;
     struct httpd_data *hd;
+    bool ws_sessions;
 } process_session_context_t;
 
 static const char *TAG = "httpd";
@@ -48,11 +60,41 @@ void esp_http_server_dispatch_event(int32_t event_id, const void* event_data, si
     }
 }
 
+static esp_err_t httpd_shed_conn(struct httpd_data *hd, int listen_fd)
+{
+    struct sockaddr_storage addr_from;
+    socklen_t addr_from_len = sizeof(addr_from);
+    int new_fd = accept(listen_fd, (struct sockaddr *)&addr_from, &addr_from_len);
+    if (new_fd < 0) {
+        ESP_LOGE(TAG, LOG_FMT("error in accept (%d)"), errno);
+        return ESP_FAIL;
+    }
+    hd->stats.shed_conns++;
+    ESP_LOGD(TAG, LOG_FMT("no session available, shedding fd = %d"), new_fd);
+
+    /* Drop the part of the request that already arrived, as closing
+     * a socket with unread data resets the connection and the client
+     * may never get to see the response */
+    char dummy[CONFIG_HTTPD_PURGE_BUF_LEN];
+    size_t purge_len = 0;
+    int recv_len;
+    while ((purge_len < HTTPD_SCRATCH_BUF) &&
+           ((recv_len = recv(new_fd, dummy, sizeof(dummy), MSG_DONTWAIT)) > 0)) {
+        purge_len += recv_len;
+    }
+
+    if (send(new_fd, httpd_shed_resp, sizeof(httpd_shed_resp) - 1, MSG_DONTWAIT) < 0) {
+        ESP_LOGD(TAG, LOG_FMT("error in send (%d)"), errno);
+    }
+    close(new_fd);
+    return ESP_OK;
+}
+
 static esp_err_t httpd_accept_conn(struct httpd_data *hd, int listen_fd)
 {
-    /* If no space is available for new session, close the least recently used one */
-    if (hd->config.lru_purge_enable == true) {
-        if (!httpd_is_sess_available(hd)) {
+    if (!httpd_is_sess_available(hd)) {
+        /* If no space is available for new session, close the least recently used one */
+        if (hd->config.lru_purge_enable && httpd_sess_get_lru(hd)) {
             /* Queue asynchronous closure of the least recently used session */
             return httpd_sess_close_lru(hd);
             /* Returning from this allowes the main server thread to process
@@ -62,6 +104,11 @@ static esp_err_t httpd_accept_conn(struct httpd_data *hd, int listen_fd)
              * with space available for one session
              */
         }
+        /* Nothing can be purged, so turn the client away now rather
+         * than leave it waiting in the backlog */
+        if (hd->config.shed_when_full) {
+            return httpd_shed_conn(hd, listen_fd);
+        }
     }
 
     struct sockaddr_storage addr_from;
@@ -119,6 +166,7 @@ static esp_err_t httpd_accept_conn(struct httpd_data *hd, int listen_fd)
         goto exit;
     }
     ESP_LOGD(TAG, LOG_FMT("complete"));
+    hd->stats.accepted_conns++;
     esp_http_server_dispatch_event(HTTP_SERVER_EVENT_ON_CONNECTED, &new_fd, sizeof(int));
     return ESP_OK;
 exit:
@@ -187,6 +235,16 @@ esp_err_t httpd_get_client_list(httpd_handle_t handle, size_t *fds, int *client_
     return ESP_OK;
 }
 
+esp_err_t httpd_get_stats(httpd_handle_t handle, httpd_stats_t *stats)
+{
+    struct httpd_data *hd = (struct httpd_data *) handle;
+    if (hd == NULL || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *stats = hd->stats;
+    return ESP_OK;
+}
+
 void *httpd_get_global_user_ctx(httpd_handle_t handle)
 {
     return ((struct httpd_data *)handle)->config.global_user_ctx;
@@ -236,6 +294,19 @@ static void httpd_process_ctrl_msg(struct httpd_data *hd)
 #endif
 }
 
+/* Only whole frames count, a partial one needs new data from the socket anyway */
+static bool httpd_sess_ws_frame_ready(struct httpd_data *hd, struct sock_db *session)
+{
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    if (session->pending_fn) {
+        return httpd_sess_pending(hd, session);
+    }
+    return httpd_ws_frame_pending(session);
+#else
+    return false;
+#endif
+}
+
 // Called for each session from httpd_server
 static int httpd_process_session(struct sock_db *session, void *context)
 {
@@ -248,12 +319,22 @@ static int httpd_process_session(struct sock_db *session, void *context)
     }
 
     process_session_context_t *ctx = (process_session_context_t *)context;
+    if (httpd_sess_is_ws(session) != ctx->ws_sessions) {
+        return 1;
+    }
     int fd = session->fd;
 
     if (FD_ISSET(fd, ctx->fdset) || httpd_sess_pending(ctx->hd, session)) {
         ESP_LOGD(TAG, LOG_FMT("processing socket %d"), fd);
         if (httpd_sess_process(ctx->hd, session) != ESP_OK) {
             httpd_sess_delete(ctx->hd, session); // Delete session
+            return 1;
+        }
+        /* httpd_ws_recv_frames() handles every buffered frame, but a
+         * handler reading one frame per request leaves the rest in the
+         * pending data where select() doesn't see them */
+        if (ctx->ws_sessions && httpd_sess_ws_frame_ready(ctx->hd, session)) {
+            ctx->hd->ws_frames_pending = true;
         }
     }
     return 1;
@@ -262,12 +343,32 @@ static int httpd_process_session(struct sock_db *session, void *context)
 /* Manage in-coming connection or data requests */
 static esp_err_t httpd_server(struct httpd_data *hd)
 {
+    /* Close HTTP sessions that outlived the keep-alive timeout before
+     * deciding on capacity, and wake up in time to close the next one */
+    struct timeval idle_tv;
+    struct timeval *select_tv = NULL;
+    int idle_timeout = httpd_sess_close_idle(hd);
+    if (idle_timeout >= 0) {
+        idle_tv.tv_sec = idle_timeout / 1000;
+        idle_tv.tv_usec = (idle_timeout % 1000) * 1000;
+        select_tv = &idle_tv;
+    }
+    if (hd->ws_frames_pending) {
+        /* A WebSocket session still has buffered frames from the last round */
+        idle_tv.tv_sec = 0;
+        idle_tv.tv_usec = 0;
+        select_tv = &idle_tv;
+        hd->ws_frames_pending = false;
+    }
+
     fd_set read_set;
     FD_ZERO(&read_set);
-    if (hd->config.lru_purge_enable || httpd_is_sess_available(hd)) {
+    if (hd->config.shed_when_full || httpd_is_sess_available(hd) ||
+        (hd->config.lru_purge_enable && httpd_sess_get_lru(hd))) {
         /* Only listen for new connections if server has capacity to
-         * handle more (or when LRU purge is enabled, in which case
-         * older connections will be closed) */
+         * handle more (or when LRU purge is enabled and there is a
+         * session which can be closed to make space, or when clients
+         * that can't be served are to be shed) */
         FD_SET(hd->listen_fd, &read_set);
     }
     FD_SET(hd->ctrl_fd, &read_set);
@@ -279,7 +380,7 @@ static esp_err_t httpd_server(struct httpd_data *hd)
     maxfd = MAX(hd->ctrl_fd, tmp_max_fd);
 
     ESP_LOGD(TAG, LOG_FMT("doing select maxfd+1 = %d"), maxfd + 1);
-    int active_cnt = select(maxfd + 1, &read_set, NULL, NULL, NULL);
+    int active_cnt = select(maxfd + 1, &read_set, NULL, NULL, select_tv);
     if (active_cnt < 0) {
         ESP_LOGE(TAG, LOG_FMT("error in select (%d)"), errno);
         httpd_sess_delete_invalid(hd);
@@ -297,12 +398,16 @@ static esp_err_t httpd_server(struct httpd_data *hd)
     }
 
     /* Case1: Do we have any activity on the current data
-     * sessions? */
+     * sessions? WebSocket sessions go first so that a burst
+     * of page loads doesn't hold up live clients */
     process_session_context_t context = {
         .fdset = &read_set,
-        .hd = hd
+        .hd = hd,
+        .ws_sessions = true
     };
     httpd_sess_enum(hd, httpd_process_session, &context);
+    context.ws_sessions = false;
+    httpd_sess_enum(hd, httpd_process_session, &context);
 
     /* Case2: Do we have any incoming connection requests to
      * process? */
@@ -482,12 +587,14 @@ esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
      *     1) listening for new TCP connections
      *     2) for sending control messages over UDP
      *     3) for receiving control messages over UDP
-     * So the total number of required sockets is max_open_sockets + 3
+     * So the total number of required sockets is max_open_sockets + 3,
+     * plus one to accept and shed clients when shed_when_full is set
      */
-    if (HTTPD_MAX_SOCKETS < config->max_open_sockets + 3) {
-        ESP_LOGE(TAG, "Config option max_open_sockets is too large (max allowed %d, 3 sockets used by HTTP server internally)\n\t"
+    int internal_sockets = config->shed_when_full ? 4 : 3;
+    if (HTTPD_MAX_SOCKETS < config->max_open_sockets + internal_sockets) {
+        ESP_LOGE(TAG, "Config option max_open_sockets is too large (max allowed %d, %d sockets used by HTTP server internally)\n\t"
                  "Either decrease this or configure LWIP_MAX_SOCKETS to a larger value",
-                 HTTPD_MAX_SOCKETS - 3);
+                 HTTPD_MAX_SOCKETS - internal_sockets, internal_sockets);
         return ESP_ERR_INVALID_ARG;
     }
 
@@ -370,6 +370,10 @@ static esp_err_t cb_headers_complete(http_parser *parser)
     r->content_len = ((int)parser->content_length != -1 ?
                       parser->content_length : 0);
 
+    /* HTTP/1.1 connections persist unless "Connection: close" is present,
+     * HTTP/1.0 ones only if "Connection: keep-alive" is present */
+    ra->keep_alive = http_should_keep_alive(parser);
+
     ESP_LOGD(TAG, LOG_FMT("bytes read     = %" PRId32 ""),  parser->nread);
     ESP_LOGD(TAG, LOG_FMT("content length = %"NEWLIB_NANO_COMPAT_FORMAT), NEWLIB_NANO_COMPAT_CAST(r->content_len));
 
@@ -664,6 +668,7 @@ static esp_err_t httpd_parse_req(struct httpd_data *hd)
     } while (parser_data.status != PARSING_COMPLETE);
 
     ESP_LOGD(TAG, LOG_FMT("parsing complete"));
+    hd->hd_req_aux.sd->req_count++;
     return httpd_uri(hd);
 }
 
@@ -688,6 +693,11 @@ static void init_req_aux(struct httpd_req_aux *ra, httpd_config_t *config)
     ra->status = 0;
     ra->content_type = 0;
     ra->first_chunk_sent = 0;
+    ra->stream_started = false;
+    ra->stream_remaining = 0;
+    ra->resp_hdr_block = NULL;
+    ra->resp_hdr_block_len = 0;
+    ra->keep_alive = false;
     ra->req_hdrs_count = 0;
     ra->resp_hdrs_count = 0;
 #if CONFIG_HTTPD_WS_SUPPORT
@@ -744,6 +754,10 @@ esp_err_t httpd_req_new(struct httpd_data *hd, struct sock_db *sd)
     ra->status = (char *)HTTPD_200;
     ra->content_type = (char *)HTTPD_TYPE_TEXT;
     ra->first_chunk_sent = false;
+    ra->stream_started = false;
+    ra->stream_remaining = 0;
+    ra->resp_hdr_block = NULL;
+    ra->resp_hdr_block_len = 0;
 
     /* Copy session info to the request */
     r->sess_ctx = sd->ctx;
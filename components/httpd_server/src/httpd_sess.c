@@ -24,6 +24,7 @@ typedef enum {
     HTTPD_TASK_SET_DESCRIPTOR,  // Set descriptor
     HTTPD_TASK_DELETE_INVALID,  // Delete invalid session
     HTTPD_TASK_FIND_LOWEST_LRU, // Find session with lowest lru
+    HTTPD_TASK_CLOSE_IDLE,      // Close sessions past keep-alive timeout
     HTTPD_TASK_CLOSE            // Close session
 } task_t;
 
@@ -34,6 +35,9 @@ typedef struct {
     int max_fd;
     struct httpd_data *hd;
     uint64_t lru_counter;
+    uint32_t now;
+    uint32_t timeout;
+    int next_timeout;
     struct sock_db    *session;
 } enum_context_t;
 
@@ -107,8 +111,8 @@ static int enum_function(struct sock_db *session, void *context)
         if (session->fd == -1) {
             return 0;
         }
-        // Only close sockets that are not in use
-        if (session->for_async_req == false) {
+        // Only close sockets that are not in use, and leave long lived WebSockets alone
+        if ((session->for_async_req == false) && !httpd_sess_is_ws(session)) {
             // Check/update lowest lru
             if (session->lru_counter < ctx->lru_counter) {
                 ctx->lru_counter = session->lru_counter;
@@ -116,6 +120,20 @@ static int enum_function(struct sock_db *session, void *context)
             }
         }
         break;
+    // Close idle HTTP sessions
+    case HTTPD_TASK_CLOSE_IDLE:
+        if ((session->fd != -1) && (session->for_async_req == false) &&
+            !httpd_sess_is_ws(session) && (session->pending_len == 0)) {
+            uint32_t idle_time = ctx->now - session->idle_since;
+            if (idle_time >= ctx->timeout) {
+                ESP_LOGD(TAG, LOG_FMT("closing idle socket %d"), session->fd);
+                httpd_sess_delete(ctx->hd, session);
+                ctx->hd->stats.idle_closed_conns++;
+            } else if ((ctx->next_timeout < 0) || ((int)(ctx->timeout - idle_time) < ctx->next_timeout)) {
+                ctx->next_timeout = (int)(ctx->timeout - idle_time);
+            }
+        }
+        break;
     case HTTPD_TASK_CLOSE:
         if (session->fd != -1) {
             ESP_LOGD(TAG, LOG_FMT("cleaning up socket %d"), session->fd);
@@ -160,6 +178,15 @@ struct sock_db *httpd_sess_get_free(struct httpd_data *hd)
     return context.session;
 }
 
+bool httpd_sess_is_ws(struct sock_db *session)
+{
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    return session->ws_handshake_done;
+#else
+    return false;
+#endif
+}
+
 bool httpd_is_sess_available(struct httpd_data *hd)
 {
     return httpd_sess_get_free(hd) ? true : false;
@@ -206,6 +233,7 @@ esp_err_t httpd_sess_new(struct httpd_data *hd, int newfd)
     session->handle = (httpd_handle_t) hd;
     session->send_fn = httpd_default_send;
     session->recv_fn = httpd_default_recv;
+    session->idle_since = httpd_os_get_time_ms();
 
     // increment number of sessions
     hd->hd_sd_active_count++;
@@ -432,6 +460,14 @@ esp_err_t httpd_sess_process(struct httpd_data *hd, struct sock_db *session)
     }
     ESP_LOGD(TAG, LOG_FMT("success"));
     session->lru_counter = ++hd->lru_counter;
+    session->idle_since = httpd_os_get_time_ms();
+
+    /* The response told the client that the connection ends here,
+     * failing makes the caller close the session */
+    if (session->close_after_resp && !session->for_async_req) {
+        ESP_LOGD(TAG, LOG_FMT("closing socket %d after response"), session->fd);
+        return ESP_FAIL;
+    }
     return ESP_OK;
 }
 
@@ -455,7 +491,7 @@ esp_err_t httpd_sess_update_lru_counter(httpd_handle_t handle, int sockfd)
     return ESP_ERR_NOT_FOUND;
 }
 
-esp_err_t httpd_sess_close_lru(struct httpd_data *hd)
+struct sock_db *httpd_sess_get_lru(struct httpd_data *hd)
 {
     enum_context_t context = {
         .task = HTTPD_TASK_FIND_LOWEST_LRU,
@@ -463,12 +499,35 @@ esp_err_t httpd_sess_close_lru(struct httpd_data *hd)
         .fd = -1
     };
     httpd_sess_enum(hd, enum_function, &context);
-    if (!context.session) {
+    return context.session;
+}
+
+esp_err_t httpd_sess_close_lru(struct httpd_data *hd)
+{
+    struct sock_db *session = httpd_sess_get_lru(hd);
+    if (!session) {
         return ESP_OK;
     }
-    ESP_LOGD(TAG, LOG_FMT("Closing session with fd %d"), context.session->fd);
-    context.session->lru_socket = true;
-    return httpd_sess_trigger_close_(hd, context.session);
+    ESP_LOGD(TAG, LOG_FMT("Closing session with fd %d"), session->fd);
+    session->lru_socket = true;
+    hd->stats.lru_purged_conns++;
+    return httpd_sess_trigger_close_(hd, session);
+}
+
+int httpd_sess_close_idle(struct httpd_data *hd)
+{
+    if (!hd->config.http_keep_alive_timeout) {
+        return -1;
+    }
+    enum_context_t context = {
+        .task = HTTPD_TASK_CLOSE_IDLE,
+        .hd = hd,
+        .now = httpd_os_get_time_ms(),
+        .timeout = hd->config.http_keep_alive_timeout * 1000,
+        .next_timeout = -1
+    };
+    httpd_sess_enum(hd, enum_function, &context);
+    return context.next_timeout;
 }
 
 esp_err_t httpd_sess_trigger_close_(httpd_handle_t handle, struct sock_db *session)
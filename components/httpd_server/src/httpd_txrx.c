@@ -187,6 +187,22 @@ esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *valu
     return ESP_OK;
 }
 
+esp_err_t httpd_resp_set_hdr_block(httpd_req_t *r, const char *block, size_t block_len)
+{
+    if (r == NULL || block == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!httpd_valid_req(r)) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+
+    struct httpd_req_aux *ra = r->aux;
+    ra->resp_hdr_block = block;
+    ra->resp_hdr_block_len = block_len;
+    return ESP_OK;
+}
+
 /**
  * This API sets the status of the HTTP response to the value specified.
  * But the status isn't sent out until any of the send APIs is executed.
@@ -225,6 +241,106 @@ esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
     return ESP_OK;
 }
 
+/* Formats the Connection (and Keep-Alive) header lines of the response into buf
+ * and decides whether the session can be reused once the response is complete */
+static int httpd_resp_fmt_conn_hdr(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    struct httpd_req_aux *ra = r->aux;
+    struct httpd_data *hd = (struct httpd_data *) r->handle;
+    uint16_t max_requests = hd->config.http_keep_alive_max_requests;
+
+    if (!ra->keep_alive || (max_requests && ra->sd->req_count >= max_requests)) {
+        ra->sd->close_after_resp = true;
+    }
+    if (ra->sd->close_after_resp) {
+        return snprintf(buf, buf_len, "Connection: close\r\n");
+    }
+    if (!hd->config.http_keep_alive_timeout) {
+        return snprintf(buf, buf_len, "Connection: keep-alive\r\n");
+    }
+    if (!max_requests) {
+        return snprintf(buf, buf_len, "Connection: keep-alive\r\nKeep-Alive: timeout=%u\r\n",
+                        hd->config.http_keep_alive_timeout);
+    }
+    return snprintf(buf, buf_len, "Connection: keep-alive\r\nKeep-Alive: timeout=%u, max=%u\r\n",
+                    hd->config.http_keep_alive_timeout, max_requests - ra->sd->req_count);
+}
+
+/* Sends the header section that starts with the hdr_len bytes of
+ * essential headers already in the scratch buffer. The connection
+ * and additional headers are packed behind them so that the whole
+ * section usually goes out in a single send */
+static esp_err_t httpd_resp_send_hdrs(httpd_req_t *r, size_t hdr_len)
+{
+    struct httpd_req_aux *ra = r->aux;
+    const char *colon_separator = ": ";
+    const char *cr_lf_seperator = "\r\n";
+    const size_t max_hdr_len = HTTPD_SCRATCH_BUF;
+
+    size_t conn_hdr_len = httpd_resp_fmt_conn_hdr(r, ra->scratch + hdr_len, sizeof(ra->scratch) - hdr_len);
+    if (conn_hdr_len >= sizeof(ra->scratch) - hdr_len) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    hdr_len += conn_hdr_len;
+
+    /* Pre-rendered lines are copied as is, only sent on their own when
+     * they can't share the buffer with the rest of the section */
+    if (ra->resp_hdr_block_len > 0) {
+        if (hdr_len + ra->resp_hdr_block_len > max_hdr_len) {
+            if (httpd_send_all(r, ra->scratch, hdr_len) != ESP_OK) {
+                return ESP_ERR_HTTPD_RESP_SEND;
+            }
+            hdr_len = 0;
+        }
+        if (ra->resp_hdr_block_len > max_hdr_len) {
+            if (httpd_send_all(r, ra->resp_hdr_block, ra->resp_hdr_block_len) != ESP_OK) {
+                return ESP_ERR_HTTPD_RESP_SEND;
+            }
+        } else {
+            memcpy(ra->scratch + hdr_len, ra->resp_hdr_block, ra->resp_hdr_block_len);
+            hdr_len += ra->resp_hdr_block_len;
+        }
+    }
+
+    for (unsigned i = 0; i < ra->resp_hdrs_count; i++) {
+        size_t field_len = strlen(ra->resp_hdrs[i].field);
+        size_t value_len = strlen(ra->resp_hdrs[i].value);
+        size_t line_len = field_len + strlen(colon_separator) + value_len + strlen(cr_lf_seperator);
+        if (hdr_len + line_len > max_hdr_len) {
+            if (httpd_send_all(r, ra->scratch, hdr_len) != ESP_OK) {
+                return ESP_ERR_HTTPD_RESP_SEND;
+            }
+            hdr_len = 0;
+        }
+        if (line_len > max_hdr_len) {
+            /* Doesn't fit even on its own, send it in pieces */
+            if (httpd_send_all(r, ra->resp_hdrs[i].field, field_len) != ESP_OK ||
+                httpd_send_all(r, colon_separator, strlen(colon_separator)) != ESP_OK ||
+                httpd_send_all(r, ra->resp_hdrs[i].value, value_len) != ESP_OK ||
+                httpd_send_all(r, cr_lf_seperator, strlen(cr_lf_seperator)) != ESP_OK) {
+                return ESP_ERR_HTTPD_RESP_SEND;
+            }
+            continue;
+        }
+        hdr_len += snprintf(ra->scratch + hdr_len, sizeof(ra->scratch) - hdr_len, "%s%s%s%s",
+                            ra->resp_hdrs[i].field, colon_separator, ra->resp_hdrs[i].value, cr_lf_seperator);
+    }
+
+    /* End header section */
+    if (hdr_len + strlen(cr_lf_seperator) > max_hdr_len) {
+        if (httpd_send_all(r, ra->scratch, hdr_len) != ESP_OK) {
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+        hdr_len = 0;
+    }
+    memcpy(ra->scratch + hdr_len, cr_lf_seperator, strlen(cr_lf_seperator));
+    hdr_len += strlen(cr_lf_seperator);
+    if (httpd_send_all(r, ra->scratch, hdr_len) != ESP_OK) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
 esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
 {
     if (r == NULL) {
@@ -237,8 +353,6 @@ esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
 
     struct httpd_req_aux *ra = r->aux;
     const char *httpd_hdr_str = "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\n";
-    const char *colon_separator = ": ";
-    const char *cr_lf_seperator = "\r\n";
 
     if (buf_len == HTTPD_RESP_USE_STRLEN) {
         buf_len = strlen(buf);
@@ -248,39 +362,14 @@ esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
     ra->req_hdrs_count = 0;
 
     /* Size of essential headers is limited by scratch buffer size */
-    if (snprintf(ra->scratch, sizeof(ra->scratch), httpd_hdr_str,
-                 ra->status, ra->content_type, buf_len) >= sizeof(ra->scratch)) {
+    int hdr_len = snprintf(ra->scratch, sizeof(ra->scratch), httpd_hdr_str,
+                           ra->status, ra->content_type, buf_len);
+    if (hdr_len >= sizeof(ra->scratch)) {
         return ESP_ERR_HTTPD_RESP_HDR;
     }
-
-    /* Sending essential headers */
-    if (httpd_send_all(r, ra->scratch, strlen(ra->scratch)) != ESP_OK) {
-        return ESP_ERR_HTTPD_RESP_SEND;
-    }
-
-    /* Sending additional headers based on set_header */
-    for (unsigned i = 0; i < ra->resp_hdrs_count; i++) {
-        /* Send header field */
-        if (httpd_send_all(r, ra->resp_hdrs[i].field, strlen(ra->resp_hdrs[i].field)) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
-        }
-        /* Send ': ' */
-        if (httpd_send_all(r, colon_separator, strlen(colon_separator)) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
-        }
-        /* Send header value */
-        if (httpd_send_all(r, ra->resp_hdrs[i].value, strlen(ra->resp_hdrs[i].value)) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
-        }
-        /* Send CR + LF */
-        if (httpd_send_all(r, cr_lf_seperator, strlen(cr_lf_seperator)) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
-        }
-    }
-
-    /* End header section */
-    if (httpd_send_all(r, cr_lf_seperator, strlen(cr_lf_seperator)) != ESP_OK) {
-        return ESP_ERR_HTTPD_RESP_SEND;
+    esp_err_t ret = httpd_resp_send_hdrs(r, hdr_len);
+    if (ret != ESP_OK) {
+        return ret;
     }
     esp_http_server_dispatch_event(HTTP_SERVER_EVENT_HEADERS_SENT, &(ra->sd->fd), sizeof(int));
 
@@ -314,47 +403,20 @@ esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len
 
     struct httpd_req_aux *ra = r->aux;
     const char *httpd_chunked_hdr_str = "HTTP/1.1 %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n";
-    const char *colon_separator = ": ";
-    const char *cr_lf_seperator = "\r\n";
 
     /* Request headers are no longer available */
     ra->req_hdrs_count = 0;
 
     if (!ra->first_chunk_sent) {
         /* Size of essential headers is limited by scratch buffer size */
-        if (snprintf(ra->scratch, sizeof(ra->scratch), httpd_chunked_hdr_str,
-                     ra->status, ra->content_type) >= sizeof(ra->scratch)) {
+        int hdr_len = snprintf(ra->scratch, sizeof(ra->scratch), httpd_chunked_hdr_str,
+                               ra->status, ra->content_type);
+        if (hdr_len >= sizeof(ra->scratch)) {
             return ESP_ERR_HTTPD_RESP_HDR;
         }
-
-        /* Sending essential headers */
-        if (httpd_send_all(r, ra->scratch, strlen(ra->scratch)) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
-        }
-
-        /* Sending additional headers based on set_header */
-        for (unsigned i = 0; i < ra->resp_hdrs_count; i++) {
-            /* Send header field */
-            if (httpd_send_all(r, ra->resp_hdrs[i].field, strlen(ra->resp_hdrs[i].field)) != ESP_OK) {
-                return ESP_ERR_HTTPD_RESP_SEND;
-            }
-            /* Send ': ' */
-            if (httpd_send_all(r, colon_separator, strlen(colon_separator)) != ESP_OK) {
-                return ESP_ERR_HTTPD_RESP_SEND;
-            }
-            /* Send header value */
-            if (httpd_send_all(r, ra->resp_hdrs[i].value, strlen(ra->resp_hdrs[i].value)) != ESP_OK) {
-                return ESP_ERR_HTTPD_RESP_SEND;
-            }
-            /* Send CR + LF */
-            if (httpd_send_all(r, cr_lf_seperator, strlen(cr_lf_seperator)) != ESP_OK) {
-                return ESP_ERR_HTTPD_RESP_SEND;
-            }
-        }
-
-        /* End header section */
-        if (httpd_send_all(r, cr_lf_seperator, strlen(cr_lf_seperator)) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
+        esp_err_t ret = httpd_resp_send_hdrs(r, hdr_len);
+        if (ret != ESP_OK) {
+            return ret;
         }
         ra->first_chunk_sent = true;
     }
@@ -385,6 +447,131 @@ esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len
     return ESP_OK;
 }
 
+esp_err_t httpd_resp_send_stream_begin(httpd_req_t *r, size_t content_len)
+{
+    if (r == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!httpd_valid_req(r)) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+
+    struct httpd_req_aux *ra = r->aux;
+    const char *httpd_hdr_str = "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %u\r\n";
+
+    if (ra->first_chunk_sent || ra->stream_started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /* Request headers are no longer available */
+    ra->req_hdrs_count = 0;
+
+    /* Size of essential headers is limited by scratch buffer size */
+    int hdr_len = snprintf(ra->scratch, sizeof(ra->scratch), httpd_hdr_str,
+                           ra->status, ra->content_type, (unsigned)content_len);
+    if (hdr_len >= sizeof(ra->scratch)) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    esp_err_t ret = httpd_resp_send_hdrs(r, hdr_len);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    esp_http_server_dispatch_event(HTTP_SERVER_EVENT_HEADERS_SENT, &(ra->sd->fd), sizeof(int));
+    ra->stream_started = true;
+    ra->stream_remaining = content_len;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_stream_data(httpd_req_t *r, const char *buf, size_t buf_len)
+{
+    if (r == NULL || (buf == NULL && buf_len > 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!httpd_valid_req(r)) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+
+    struct httpd_req_aux *ra = r->aux;
+    if (!ra->stream_started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (buf_len > ra->stream_remaining) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    /* Body goes out as is, the length was announced up front */
+    if (buf_len > 0 && httpd_send_all(r, buf, buf_len) != ESP_OK) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    ra->stream_remaining -= buf_len;
+    esp_http_server_event_data evt_data = {
+        .fd = ra->sd->fd,
+        .data_len = buf_len,
+    };
+    esp_http_server_dispatch_event(HTTP_SERVER_EVENT_SENT_DATA, &evt_data, sizeof(esp_http_server_event_data));
+    return ESP_OK;
+}
+
+int httpd_resp_try_send_stream_data(httpd_req_t *r, const char *buf, size_t buf_len)
+{
+    if (r == NULL || buf == NULL) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+
+    if (!httpd_valid_req(r)) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+
+    struct httpd_req_aux *ra = r->aux;
+    if (!ra->stream_started || buf_len > ra->stream_remaining) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+
+    int ret = ra->sd->send_fn(ra->sd->handle, ra->sd->fd, buf, buf_len, MSG_DONTWAIT);
+    if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+        /* Send buffer is full */
+        return 0;
+    }
+    if (ret < 0) {
+        ESP_LOGD(TAG, LOG_FMT("error in send_fn"));
+        return ret;
+    }
+    ra->stream_remaining -= ret;
+    esp_http_server_event_data evt_data = {
+        .fd = ra->sd->fd,
+        .data_len = ret,
+    };
+    esp_http_server_dispatch_event(HTTP_SERVER_EVENT_SENT_DATA, &evt_data, sizeof(esp_http_server_event_data));
+    return ret;
+}
+
+esp_err_t httpd_resp_send_stream_end(httpd_req_t *r)
+{
+    if (r == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!httpd_valid_req(r)) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+
+    struct httpd_req_aux *ra = r->aux;
+    if (!ra->stream_started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ra->stream_started = false;
+    if (ra->stream_remaining > 0) {
+        /* The client would take the next response as the rest of the body */
+        ESP_LOGW(TAG, LOG_FMT("stream ended %u bytes short, closing socket %d"),
+                 (unsigned)ra->stream_remaining, ra->sd->fd);
+        ra->sd->close_after_resp = true;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
 esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *usr_msg)
 {
     esp_err_t ret;
@@ -512,6 +699,8 @@ esp_err_t httpd_req_handle_err(httpd_req_t *req, httpd_err_code_t error)
         /* If no handler is registered for this error default
          * behavior is to send the HTTP error response and
          * return failure for closure of underlying socket */
+        struct httpd_req_aux *ra = req->aux;
+        ra->sd->close_after_resp = true;
         httpd_resp_send_err(req, error, NULL);
         ret = ESP_FAIL;
     }
@@ -617,7 +806,12 @@ int httpd_req_to_sockfd(httpd_req_t *r)
 static int httpd_sock_err(const char *ctx, int sockfd)
 {
     int errval;
-    ESP_LOGW(TAG, LOG_FMT("error in %s : %d"), ctx, errno);
+    if (errno == EAGAIN) {
+        /* Expected from non-blocking calls, keep it out of the warnings */
+        ESP_LOGD(TAG, LOG_FMT("error in %s : %d"), ctx, errno);
+    } else {
+        ESP_LOGW(TAG, LOG_FMT("error in %s : %d"), ctx, errno);
+    }
 
     switch(errno) {
     case EAGAIN:
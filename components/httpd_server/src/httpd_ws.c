@@ -363,6 +363,184 @@ esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *frame, size_t
     return ESP_OK;
 }
 
+/* Parses the header of the frame starting at buf. hdr_len is 0 if buf_len
+ * doesn't cover the header yet. Lengths that can't fit the scratch buffer
+ * are rejected before they are added to anything, since a 64 bit length
+ * could wrap the frame size and pass the bounds checks of the callers */
+static esp_err_t httpd_ws_parse_header(const uint8_t *buf, size_t buf_len, size_t *hdr_len,
+                                       size_t *payload_len, bool *masked)
+{
+    *hdr_len = 0;
+    *payload_len = 0;
+    if (buf_len < 2) {
+        return ESP_OK;
+    }
+
+    *masked = (buf[1] & HTTPD_WS_MASK_BIT) != 0;
+    uint8_t init_len = buf[1] & HTTPD_WS_LENGTH_BITS;
+    size_t len_size = 0;
+    uint64_t len = init_len;
+    if (init_len == 126) {
+        len_size = 2;
+    } else if (init_len == 127) {
+        len_size = 8;
+    }
+    if (buf_len < 2 + len_size) {
+        return ESP_OK;
+    }
+    if (len_size > 0) {
+        len = 0;
+        for (size_t idx = 2; idx < 2 + len_size; idx++) {
+            len = (len << 8U) | buf[idx];
+        }
+    }
+
+    size_t header_len = 2 + len_size + (*masked ? 4 : 0);
+    /* Please refer to RFC6455 Section 5.2, the most significant bit of a 64 bit length must be 0 */
+    if ((len >> 63) != 0 || len > HTTPD_SCRATCH_BUF - header_len) {
+        ESP_LOGW(TAG, LOG_FMT("WS frame length is invalid or too long for the scratch buffer"));
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *payload_len = (size_t)len;
+    *hdr_len = (buf_len < header_len) ? 0 : header_len;
+    return ESP_OK;
+}
+
+bool httpd_ws_frame_pending(struct sock_db *sd)
+{
+    const uint8_t *buf = (const uint8_t *)sd->pending_data + sizeof(sd->pending_data) - sd->pending_len;
+    size_t hdr_len = 0;
+    size_t payload_len = 0;
+    bool masked = false;
+    if (httpd_ws_parse_header(buf, sd->pending_len, &hdr_len, &payload_len, &masked) != ESP_OK) {
+        /* Let the session handle it, the invalid length closes the session */
+        return true;
+    }
+    return hdr_len != 0 && sd->pending_len - hdr_len >= payload_len;
+}
+
+/* Blocks until more data arrives, appending it to buf */
+static esp_err_t httpd_ws_recv_more(struct sock_db *sd, uint8_t *buf, size_t *buf_len, size_t buf_size)
+{
+    int recv_len = sd->recv_fn(sd->handle, sd->fd, (char *)buf + *buf_len, buf_size - *buf_len, 0);
+    if (recv_len <= 0) {
+        return ESP_FAIL;
+    }
+    *buf_len += recv_len;
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_recv_frames(httpd_req_t *req, httpd_ws_frame_cb_t cb, void *arg)
+{
+    esp_err_t ret = httpd_ws_check_req(req);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (!cb) {
+        ESP_LOGW(TAG, LOG_FMT("Callback is invalid"));
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct httpd_req_aux *aux = req->aux;
+    struct sock_db *sd = aux->sd;
+    uint8_t *buf = (uint8_t *)aux->scratch;
+    const size_t buf_size = HTTPD_SCRATCH_BUF;
+
+    /* The first byte was already consumed by httpd_ws_get_frame_type() */
+    buf[0] = (aux->ws_final ? HTTPD_WS_FIN_BIT : 0) | aux->ws_type;
+    size_t buf_len = 1;
+
+    /* Take whatever is buffered without waiting for more */
+    if (sd->pending_len > 0) {
+        buf_len += httpd_recv_with_opt(req, (char *)buf + buf_len, buf_size - buf_len, true);
+    }
+    if (buf_len < buf_size) {
+        int recv_len = sd->recv_fn(sd->handle, sd->fd, (char *)buf + buf_len, buf_size - buf_len, MSG_DONTWAIT);
+        if (recv_len > 0) {
+            buf_len += recv_len;
+        }
+    }
+
+    size_t offset = 0;
+    size_t total_frames = 0;
+    while (offset < buf_len) {
+        uint8_t *frame_buf = buf + offset;
+        size_t avail = buf_len - offset;
+        size_t hdr_len = 0;
+        size_t payload_len = 0;
+        bool masked = false;
+        ret = httpd_ws_parse_header(frame_buf, avail, &hdr_len, &payload_len, &masked);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        /* hdr_len + payload_len can't wrap, the parser capped it at buf_size */
+        if (hdr_len == 0 || avail < hdr_len + payload_len) {
+            /* Keep the partial frame for the next pass if something was dispatched in this one */
+            if (total_frames > 0 && avail <= sizeof(sd->pending_data)) {
+                httpd_unrecv(req, (const char *)frame_buf, avail);
+                return ESP_OK;
+            }
+            /* Otherwise wait for the rest of it */
+            memmove(buf, frame_buf, avail);
+            offset = 0;
+            buf_len = avail;
+            if (httpd_ws_recv_more(sd, buf, &buf_len, buf_size) != ESP_OK) {
+                if (total_frames == 0 && aux->ws_type == HTTPD_WS_TYPE_CLOSE) {
+                    /* Broken connections are reported as a CLOSE frame by httpd_ws_get_frame_type() */
+                    httpd_ws_frame_t frame = {
+                        .final = true,
+                        .fragmented = false,
+                        .type = HTTPD_WS_TYPE_CLOSE,
+                        .payload = NULL,
+                        .len = 0,
+                    };
+                    return cb(req, &frame, arg);
+                }
+                ESP_LOGW(TAG, LOG_FMT("Failed to receive the rest of the frame"));
+                return ESP_FAIL;
+            }
+            continue;
+        }
+
+        if (!masked) {
+            /* Please refer to RFC6455 Section 5.2 for more details. */
+            ESP_LOGW(TAG, LOG_FMT("WS frame is not properly masked."));
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        httpd_ws_frame_t frame = {
+            .final = (frame_buf[0] & HTTPD_WS_FIN_BIT) != 0,
+            .fragmented = false,
+            .type = frame_buf[0] & HTTPD_WS_OPCODE_BITS,
+            .payload = frame_buf + hdr_len,
+            .len = payload_len,
+        };
+        if (frame.len > 0) {
+            httpd_ws_unmask_payload(frame.payload, frame.len, frame_buf + hdr_len - sizeof(aux->mask_key));
+        }
+        offset += hdr_len + payload_len;
+        total_frames++;
+
+        aux->ws_type = frame.type;
+        aux->ws_final = frame.final;
+        if (frame.type == HTTPD_WS_TYPE_CLOSE) {
+            sd->ws_close = true;
+        }
+        ESP_LOGD(TAG, LOG_FMT("Dispatching WS frame type=%d, len=%d"), frame.type, (int)frame.len);
+
+        ret = cb(req, &frame, arg);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        if (sd->ws_close) {
+            /* Nothing after a CLOSE frame is meaningful */
+            return ESP_OK;
+        }
+    }
+    return ESP_OK;
+}
+
 esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *frame)
 {
     esp_err_t ret = httpd_ws_check_req(req);
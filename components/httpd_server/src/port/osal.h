@@ -57,6 +57,12 @@ static inline othread_t httpd_os_thread_handle()
     return xTaskGetCurrentTaskHandle();
 }
 
+/* Millisecond timestamp with tick resolution, wraps around so only compare differences */
+static inline uint32_t httpd_os_get_time_ms()
+{
+    return (uint32_t)xTaskGetTickCount() * portTICK_RATE_MS;
+}
+
 #ifdef __cplusplus
 }
 #endif
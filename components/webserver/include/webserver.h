@@ -3,7 +3,24 @@
 
 #include <httpd_server/esp_http_server.h>
 #include <esp_err.h>
+#include <stdint.h>
 
+struct WebserverStats {
+    // assets are verified once in the background after boot
+    uint32_t verified_assets;
+    uint32_t unhealthy_assets;
+    uint32_t hashed_bytes;
+    uint32_t hash_time_us;
+    uint32_t hash_bytes_per_ms;
+    // RAM cache of small static files
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+    uint32_t cache_evictions;
+};
+
+// registers a single "/*" handler for every file in the bundle
+// the server needs httpd_uri_match_wildcard() as its uri_match_fn and other handlers have to be registered first
 esp_err_t webserver_register_endpoints(httpd_handle_t server);
+void webserver_get_stats(struct WebserverStats* stats);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "asset_bundle.h"
+
+#include <esp_log.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* TAG = "asset_bundle";
+
+// index of each mimetype is its id, must match MIMETYPE_IDS in ./scripts/create_server_bundle.py
+static const char* MIMETYPES[] = {
+    "application/octet-stream",
+    "text/html",
+    "application/javascript",
+    "text/css",
+    "image/x-icon",
+    "application/json",
+    "image/png",
+    "image/svg+xml",
+    "text/plain",
+};
+static const size_t TOTAL_MIMETYPES = sizeof(MIMETYPES)/sizeof(MIMETYPES[0]);
+
+esp_err_t asset_bundle_open(struct AssetBundle* bundle, const char* partition_label) {
+    assert(bundle != NULL);
+    assert(partition_label != NULL);
+    bundle->partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partition_label);
+    if (bundle->partition == NULL) {
+        ESP_LOGE(TAG, "failed to find partition '%s'", partition_label);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    struct AssetBundleHeader* header = &bundle->header;
+    const esp_err_t read_status = esp_partition_read(bundle->partition, 0, header, sizeof(struct AssetBundleHeader));
+    if (read_status != ESP_OK) {
+        ESP_LOGE(TAG, "failed to read bundle header (%s)", esp_err_to_name(read_status));
+        return read_status;
+    }
+    if (header->magic != ASSET_BUNDLE_MAGIC) {
+        ESP_LOGE(TAG, "partition '%s' doesn't hold a bundle, magic=0x%08x", partition_label, header->magic);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (header->version != ASSET_BUNDLE_VERSION) {
+        ESP_LOGE(TAG, "unsupported bundle version %u, expected %u", header->version, ASSET_BUNDLE_VERSION);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    const size_t table_end = sizeof(struct AssetBundleHeader) + header->total_entries*sizeof(struct AssetBundleEntry);
+    if (header->total_size > bundle->partition->size || table_end > header->strings_offset ||
+        header->strings_offset > header->index_size || header->index_size > header->total_size) {
+        ESP_LOGE(TAG, "bundle of %u bytes with %u entries doesn't fit partition of %u bytes", header->total_size, header->total_entries, bundle->partition->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // entries, paths and headers are looked up on every request so keep them in RAM
+    bundle->index = malloc(header->index_size);
+    if (bundle->index == NULL) {
+        ESP_LOGE(TAG, "failed to allocate %u bytes for the bundle index", header->index_size);
+        return ESP_ERR_NO_MEM;
+    }
+    const esp_err_t index_status = esp_partition_read(bundle->partition, 0, bundle->index, header->index_size);
+    if (index_status != ESP_OK) {
+        ESP_LOGE(TAG, "failed to read bundle index (%s)", esp_err_to_name(index_status));
+        free(bundle->index);
+        bundle->index = NULL;
+        return index_status;
+    }
+    ESP_LOGI(TAG, "opened bundle with %u entries, size=%u, index_size=%u", header->total_entries, header->total_size, header->index_size);
+    return ESP_OK;
+}
+
+esp_err_t asset_bundle_read(const struct AssetBundle* bundle, size_t offset, void* data, size_t size) {
+    assert(bundle != NULL);
+    assert(bundle->partition != NULL);
+    if (offset + size > bundle->header.total_size) return ESP_ERR_INVALID_SIZE;
+    return esp_partition_read(bundle->partition, offset, data, size);
+}
+
+esp_err_t asset_bundle_read_entry(const struct AssetBundle* bundle, size_t index, struct AssetBundleEntry* entry) {
+    assert(bundle != NULL);
+    assert(bundle->index != NULL);
+    assert(entry != NULL);
+    if (index >= bundle->header.total_entries) return ESP_ERR_INVALID_ARG;
+    const size_t offset = sizeof(struct AssetBundleHeader) + index*sizeof(struct AssetBundleEntry);
+    // entries are packed so they can't be used in place
+    memcpy(entry, &bundle->index[offset], sizeof(struct AssetBundleEntry));
+    const struct AssetBundleHeader* header = &bundle->header;
+    const bool is_data_valid = entry->data_offset >= header->index_size && entry->data_offset <= header->total_size &&
+        entry->data_length <= header->total_size - entry->data_offset;
+    const bool is_header_valid = entry->header_offset >= header->strings_offset && entry->header_offset <= header->index_size &&
+        entry->header_length <= header->index_size - entry->header_offset;
+    if (!is_data_valid || !is_header_valid) {
+        ESP_LOGE(TAG, "entry %u is outside of the bundle", index);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+const char* asset_bundle_get_path(const struct AssetBundle* bundle, const struct AssetBundleEntry* entry) {
+    assert(bundle != NULL);
+    assert(entry != NULL);
+    if (entry->path_offset < bundle->header.strings_offset || entry->path_offset >= bundle->header.index_size) {
+        return NULL;
+    }
+    // paths near the end of the index are shorter than the maximum
+    size_t size = bundle->header.index_size - entry->path_offset;
+    if (size > ASSET_BUNDLE_MAX_PATH_LENGTH) size = ASSET_BUNDLE_MAX_PATH_LENGTH;
+    const char* path = (const char*)&bundle->index[entry->path_offset];
+    if (memchr(path, '\0', size) == NULL) return NULL;
+    return path;
+}
+
+const char* asset_bundle_get_headers(const struct AssetBundle* bundle, const struct AssetBundleEntry* entry) {
+    assert(bundle != NULL);
+    assert(entry != NULL);
+    // range was checked when the entry was read
+    return (const char*)&bundle->index[entry->header_offset];
+}
+
+uint32_t asset_bundle_hash_path(const char* path) {
+    // 32bit FNV-1a
+    uint32_t value = 0x811C9DC5;
+    for (const uint8_t* c = (const uint8_t*)path; *c != '\0'; c++) {
+        value ^= *c;
+        value *= 0x01000193;
+    }
+    return value;
+}
+
+const char* asset_bundle_get_mimetype(uint8_t mime_id) {
+    if (mime_id >= TOTAL_MIMETYPES) return MIMETYPES[0];
+    return MIMETYPES[mime_id];
+}
@@ -0,0 +1,63 @@
+#ifndef __ASSET_BUNDLE_H__
+#define __ASSET_BUNDLE_H__
+
+#include <esp_err.h>
+#include <esp_partition.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// all website files packed into one raw data partition by ./scripts/create_server_bundle.py
+// layout must match the script, all fields are little endian
+#define ASSET_BUNDLE_MAGIC 0x31425341 // "ASB1"
+#define ASSET_BUNDLE_VERSION 2
+#define ASSET_BUNDLE_PARTITION_LABEL "assets"
+#define ASSET_BUNDLE_SHA1_SIZE 20
+#define ASSET_BUNDLE_MAX_PATH_LENGTH 64
+
+enum AssetEncoding {
+    ASSET_ENCODING_IDENTITY = 0,
+    ASSET_ENCODING_GZIP = 1,
+};
+
+struct AssetBundleHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t total_entries;
+    uint32_t strings_offset;
+    // entries, paths and header blocks come before this offset, file data after it
+    uint32_t index_size;
+    uint32_t total_size;
+} __attribute__((packed));
+
+// sorted by path_hash, variants of a path are next to each other
+struct AssetBundleEntry {
+    uint32_t path_hash;
+    uint32_t path_offset;
+    uint32_t data_offset;
+    uint32_t data_length;
+    // pre-rendered header lines sent with every response of this variant
+    uint32_t header_offset;
+    uint8_t mime_id;
+    uint8_t encoding;
+    uint16_t header_length;
+    uint8_t sha1[ASSET_BUNDLE_SHA1_SIZE];
+} __attribute__((packed));
+
+struct AssetBundle {
+    const esp_partition_t* partition;
+    struct AssetBundleHeader header;
+    // copy of the first index_size bytes, read once at boot
+    uint8_t* index;
+};
+
+esp_err_t asset_bundle_open(struct AssetBundle* bundle, const char* partition_label);
+esp_err_t asset_bundle_read(const struct AssetBundle* bundle, size_t offset, void* data, size_t size);
+esp_err_t asset_bundle_read_entry(const struct AssetBundle* bundle, size_t index, struct AssetBundleEntry* entry);
+// pointers into the index which stay valid while the bundle is open, NULL if out of bounds
+const char* asset_bundle_get_path(const struct AssetBundle* bundle, const struct AssetBundleEntry* entry);
+const char* asset_bundle_get_headers(const struct AssetBundle* bundle, const struct AssetBundleEntry* entry);
+uint32_t asset_bundle_hash_path(const char* path);
+const char* asset_bundle_get_mimetype(uint8_t mime_id);
+
+#endif
@@ -0,0 +1,115 @@
+#include "asset_cache.h"
+
+#include <esp_log.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* TAG = "asset_cache";
+
+void asset_cache_init(struct AssetCache* cache, size_t budget, size_t max_file_size) {
+    assert(cache != NULL);
+    memset(cache, 0, sizeof(struct AssetCache));
+    cache->budget = budget;
+    cache->max_file_size = max_file_size;
+}
+
+bool asset_cache_is_cacheable(const struct AssetCache* cache, size_t size) {
+    assert(cache != NULL);
+    return size <= cache->max_file_size && size <= cache->budget;
+}
+
+const struct AssetCacheEntry* asset_cache_get(struct AssetCache* cache, const uint8_t* key) {
+    assert(cache != NULL);
+    assert(key != NULL);
+    for (size_t i = 0; i < ASSET_CACHE_MAX_ENTRIES; i++) {
+        struct AssetCacheEntry* entry = cache->entries[i];
+        if (entry == NULL) continue;
+        if (memcmp(entry->key, key, ASSET_CACHE_KEY_SIZE) != 0) continue;
+        entry->last_used = ++cache->lru_counter;
+        cache->stats.hits++;
+        return entry;
+    }
+    cache->stats.misses++;
+    return NULL;
+}
+
+static void asset_cache_remove_index(struct AssetCache* cache, size_t index) {
+    struct AssetCacheEntry* entry = cache->entries[index];
+    assert(entry != NULL);
+    cache->used -= entry->size;
+    cache->entries[index] = NULL;
+    free(entry);
+}
+
+static bool asset_cache_evict_lru(struct AssetCache* cache) {
+    size_t lru_index = ASSET_CACHE_MAX_ENTRIES;
+    for (size_t i = 0; i < ASSET_CACHE_MAX_ENTRIES; i++) {
+        const struct AssetCacheEntry* entry = cache->entries[i];
+        if (entry == NULL) continue;
+        if (lru_index == ASSET_CACHE_MAX_ENTRIES || entry->last_used < cache->entries[lru_index]->last_used) {
+            lru_index = i;
+        }
+    }
+    if (lru_index == ASSET_CACHE_MAX_ENTRIES) return false;
+    ESP_LOGD(TAG, "evicting slot=%u, size=%u", lru_index, cache->entries[lru_index]->size);
+    asset_cache_remove_index(cache, lru_index);
+    cache->stats.evictions++;
+    return true;
+}
+
+static size_t asset_cache_find_free_slot(const struct AssetCache* cache) {
+    for (size_t i = 0; i < ASSET_CACHE_MAX_ENTRIES; i++) {
+        if (cache->entries[i] == NULL) return i;
+    }
+    return ASSET_CACHE_MAX_ENTRIES;
+}
+
+struct AssetCacheEntry* asset_cache_insert(struct AssetCache* cache, const uint8_t* key, size_t size) {
+    assert(cache != NULL);
+    assert(key != NULL);
+    if (!asset_cache_is_cacheable(cache, size)) return NULL;
+
+    while (cache->used + size > cache->budget) {
+        if (!asset_cache_evict_lru(cache)) return NULL;
+    }
+    size_t index = asset_cache_find_free_slot(cache);
+    if (index == ASSET_CACHE_MAX_ENTRIES) {
+        if (!asset_cache_evict_lru(cache)) return NULL;
+        index = asset_cache_find_free_slot(cache);
+    }
+
+    struct AssetCacheEntry* entry = malloc(sizeof(struct AssetCacheEntry) + size);
+    if (entry == NULL) {
+        ESP_LOGW(TAG, "failed to allocate %u bytes for slot=%u", size, index);
+        return NULL;
+    }
+    memcpy(entry->key, key, ASSET_CACHE_KEY_SIZE);
+    entry->last_used = ++cache->lru_counter;
+    entry->size = size;
+    cache->entries[index] = entry;
+    cache->used += size;
+    return entry;
+}
+
+void asset_cache_invalidate(struct AssetCache* cache, const uint8_t* key) {
+    assert(cache != NULL);
+    assert(key != NULL);
+    for (size_t i = 0; i < ASSET_CACHE_MAX_ENTRIES; i++) {
+        const struct AssetCacheEntry* entry = cache->entries[i];
+        if (entry == NULL || memcmp(entry->key, key, ASSET_CACHE_KEY_SIZE) != 0) continue;
+        asset_cache_remove_index(cache, i);
+        return;
+    }
+}
+
+void asset_cache_remove(struct AssetCache* cache, struct AssetCacheEntry* entry) {
+    assert(cache != NULL);
+    assert(entry != NULL);
+    for (size_t i = 0; i < ASSET_CACHE_MAX_ENTRIES; i++) {
+        if (cache->entries[i] != entry) continue;
+        asset_cache_remove_index(cache, i);
+        return;
+    }
+}
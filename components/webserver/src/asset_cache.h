@@ -0,0 +1,48 @@
+#ifndef __ASSET_CACHE_H__
+#define __ASSET_CACHE_H__
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// small assets kept in RAM so hits skip the flash reads
+// only used from the httpd task so there is no locking
+#define ASSET_CACHE_MAX_ENTRIES 16
+#define ASSET_CACHE_KEY_SIZE 20 // sha_1 digest
+
+struct AssetCacheEntry {
+    uint8_t key[ASSET_CACHE_KEY_SIZE];
+    uint32_t last_used;
+    size_t size;
+    uint8_t data[];
+};
+
+struct AssetCacheStats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+};
+
+struct AssetCache {
+    // total size of cached data is kept below budget, larger files are never cached
+    size_t budget;
+    size_t max_file_size;
+    size_t used;
+    uint32_t lru_counter;
+    struct AssetCacheEntry* entries[ASSET_CACHE_MAX_ENTRIES];
+    struct AssetCacheStats stats;
+};
+
+void asset_cache_init(struct AssetCache* cache, size_t budget, size_t max_file_size);
+bool asset_cache_is_cacheable(const struct AssetCache* cache, size_t size);
+// returns NULL on a miss
+const struct AssetCacheEntry* asset_cache_get(struct AssetCache* cache, const uint8_t* key);
+// evicts least recently used entries until size fits, the caller fills entry->data
+// returns NULL if the file can't be cached or the allocation failed
+struct AssetCacheEntry* asset_cache_insert(struct AssetCache* cache, const uint8_t* key, size_t size);
+void asset_cache_remove(struct AssetCache* cache, struct AssetCacheEntry* entry);
+// drops the entry with the key if there is one, doesn't count as a hit or miss
+void asset_cache_invalidate(struct AssetCache* cache, const uint8_t* key);
+
+#endif
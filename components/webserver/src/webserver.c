@@ -1,294 +1,659 @@
 #include "webserver.h"
+#include "asset_bundle.h"
+#include "asset_cache.h"
 
 #include <httpd_server/esp_http_server.h>
 #include <esp_log.h>
 #include <esp_err.h>
-#include <esp_spiffs.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
-#include <dirent.h>
-#include <sys/stat.h>
 #include <string.h>
+#include <ctype.h>
+#include <esp_timer.h>
+#include <mbedtls/sha1.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 
 static const char* TAG = "webserver";
-static const char SERVER_FILES_FILEPATH[] = "server_files.csv";
 
-#define MAX_ETAG_LENGTH 64 // sha_1 hexdigest is 40 hexadecimal digits
 #define SCRATCH_BUFFER_SIZE 512
 static uint8_t SCRATCH_BUFFER[SCRATCH_BUFFER_SIZE] = {0};
+static struct AssetBundle ASSET_BUNDLE;
+static struct AssetCache ASSET_CACHE;
+// block size matches the TCP MSS so each block fills whole segments
+#define STREAM_BLOCK_SIZE CONFIG_WEBSERVER_STREAM_BLOCK_SIZE
+static uint8_t STREAM_BUFFERS[2][STREAM_BLOCK_SIZE] = {0};
+
+enum AssetHealth {
+    ASSET_HEALTH_UNVERIFIED = 0,
+    ASSET_HEALTH_VERIFIED,
+    // data doesn't hash to the sha1 in the bundle index
+    ASSET_HEALTH_UNHEALTHY,
+};
 
-struct EndpointFile {
-    char* filepath;
-    char* mimetype;
-    char* sha1_hash;
+// stored copy of a file in the bundle, either as is or compressed
+struct EndpointVariant {
+    size_t data_offset;
     size_t file_size;
+    // word aligned so ETags compare a word at a time
+    uint32_t sha1[ASSET_BUNDLE_SHA1_SIZE/sizeof(uint32_t)];
+    // ETag, Cache-Control and encoding lines rendered by the bundle script
+    const char* headers;
+    size_t headers_length;
+    // written by the verify task once the data was hashed
+    volatile uint8_t health;
+};
+
+// uri and headers point into the bundle index and mimetype into its static table
+// so each endpoint is a single record without allocations of its own
+struct EndpointFile {
+    const char* uri;
+    uint32_t path_hash;
+    const char* mimetype;
+    bool has_gzip;
+    struct EndpointVariant identity;
+    struct EndpointVariant gzip;
 };
 
-void free_endpoint(struct EndpointFile* file) {
-    if (file->filepath != NULL) free(file->filepath);
-    if (file->mimetype != NULL) free(file->mimetype);
-    if (file->sha1_hash != NULL) free(file->sha1_hash);
-    if (file != NULL) free(file);
+// all endpoint records in one allocation made at boot and never freed
+// sorted by path_hash like the bundle entries so requests are resolved with a binary search
+static struct EndpointFile* ENDPOINTS = NULL;
+static size_t TOTAL_ENDPOINTS = 0;
+
+// files are hashed after the server is up so a corrupted flash page can't hide behind its indexed etag
+#define VERIFY_TASK_STACK_SIZE 2048
+#define VERIFY_TASK_PRIORITY (tskIDLE_PRIORITY+1)
+#define VERIFY_BLOCK_SIZE 512
+static struct WebserverStats STATS = {0};
+
+#define SHA1_HEX_LENGTH (2*ASSET_BUNDLE_SHA1_SIZE)
+
+// hex must hold SHA1_HEX_LENGTH+1 characters
+static void format_sha1_hex(const uint8_t* sha1, char* hex) {
+    static const char DIGITS[] = "0123456789abcdef";
+    for (size_t i = 0; i < ASSET_BUNDLE_SHA1_SIZE; i++) {
+        hex[2*i] = DIGITS[sha1[i] >> 4];
+        hex[2*i+1] = DIGITS[sha1[i] & 0x0F];
+    }
+    hex[SHA1_HEX_LENGTH] = '\0';
 }
 
-static esp_err_t handle_endpoint_file_request(httpd_req_t *request) {
-    assert(request != NULL);
-    const struct EndpointFile* file = (struct EndpointFile*)(request->user_ctx);
-    assert(file != NULL);
+static int get_hex_digit_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
 
-    // SOURCE: https://devdojo.com/vnnvanhuong/demo-http-caching-with-etag
-    // Support file caching
-    bool is_cache = false;
-    const esp_err_t etag_status = httpd_req_get_hdr_value_str(request, "If-None-Match", (char *)SCRATCH_BUFFER, MAX_ETAG_LENGTH);
-    if (etag_status == ESP_OK) {
-        if (strncmp(file->sha1_hash, (char *)SCRATCH_BUFFER, MAX_ETAG_LENGTH) == 0) {
-            is_cache = true;
-        } else {
-            is_cache = false;
-            ESP_LOGI(TAG, "cache miss: rx_sha1='%s', stored_sha1='%s', uri='%s'", (char *)SCRATCH_BUFFER, file->sha1_hash, request->uri);
-        }
-    } else if (etag_status != ESP_ERR_NOT_FOUND) {
-        ESP_LOGE(TAG, "request contained malformed 'If-None-Match' etag (%s), uri='%s'", esp_err_to_name(etag_status), request->uri);
+// hex must be SHA1_HEX_LENGTH digits, false if any isn't a hex digit
+static bool decode_sha1_hex(const char* hex, uint32_t* sha1) {
+    uint8_t* bytes = (uint8_t*)sha1;
+    for (size_t i = 0; i < ASSET_BUNDLE_SHA1_SIZE; i++) {
+        const int high = get_hex_digit_value(hex[2*i]);
+        const int low = get_hex_digit_value(hex[2*i+1]);
+        if (high < 0 || low < 0) return false;
+        bytes[i] = (uint8_t)((high << 4) | low);
     }
+    return true;
+}
 
-    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_hdr(request, "ETag", file->sha1_hash));
-    // cache for 1 week, always check if etag matches
-    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_hdr(request, "Cache-Control", "max-age=604800, public, no-cache"));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_type(request, file->mimetype));
-    if (is_cache) {
-        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_status(request, "304 Not Modified"));
-        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_send(request, NULL, 0));
-        return ESP_OK;
+static bool is_sha1_equal(const uint32_t* a, const uint32_t* b) {
+    uint32_t difference = 0;
+    for (size_t i = 0; i < ASSET_BUNDLE_SHA1_SIZE/sizeof(uint32_t); i++) {
+        difference |= a[i] ^ b[i];
     }
+    return difference == 0;
+}
 
-    // stream the file
-    FILE* fd = fopen(file->filepath, "rb");
-    if (fd == NULL) {
-        ESP_LOGE(TAG, "Failed to open file: %s", file->filepath);
-        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_send_err(request, HTTPD_404_NOT_FOUND, "File not found"));
-        return ESP_FAIL;
+// true if If-None-Match lists the sha1 or is "*"
+// handles quoted, weak (W/) and comma separated tags along with the unquoted tags sent by older versions
+// weak tags match too since If-None-Match uses weak comparison
+static bool is_etag_matched(const char* if_none_match, const uint32_t* sha1) {
+    uint32_t digest[ASSET_BUNDLE_SHA1_SIZE/sizeof(uint32_t)];
+    const char* c = if_none_match;
+    while (*c != '\0') {
+        while (*c == ' ' || *c == '\t' || *c == ',') c++;
+        if (*c == '\0') break;
+        if (*c == '*') return true;
+        if (c[0] == 'W' && c[1] == '/') c += 2;
+
+        const bool is_quoted = *c == '"';
+        if (is_quoted) c++;
+        const char* tag = c;
+        if (is_quoted) {
+            while (*c != '\0' && *c != '"') c++;
+        } else {
+            while (*c != '\0' && *c != ',' && *c != ' ' && *c != '\t') c++;
+        }
+        const size_t tag_length = c - tag;
+        // a tag cut off by a truncated header has no closing quote
+        const bool is_complete = !is_quoted || *c == '"';
+        if (is_quoted && *c == '"') c++;
+        if (is_complete && tag_length == SHA1_HEX_LENGTH && decode_sha1_hex(tag, digest) && is_sha1_equal(digest, sha1)) {
+            return true;
+        }
+        while (*c != '\0' && *c != ',') c++;
     }
-    bool is_success = true;
-    while (true) {
-        const size_t total_read_bytes = fread(SCRATCH_BUFFER, 1, SCRATCH_BUFFER_SIZE, fd);
-        if (total_read_bytes == 0) break;
-        const esp_err_t block_send_status = httpd_resp_send_chunk(request, (char *)SCRATCH_BUFFER, total_read_bytes);
-        if (block_send_status != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to stream block of size %u for uri='%s' due to error '%s'", total_read_bytes, request->uri, esp_err_to_name(etag_status));
-            is_success = false;
-            break;
+    return false;
+}
+
+static bool has_gzip_variant(const struct EndpointFile* file) {
+    return file->has_gzip;
+}
+
+static bool is_variant_healthy(const struct EndpointVariant* variant) {
+    return variant->health != ASSET_HEALTH_UNHEALTHY;
+}
+
+// true if the coding is listed in Accept-Encoding without being disabled by q=0
+static bool is_encoding_accepted(const char* accept_encoding, const char* coding) {
+    const size_t coding_length = strlen(coding);
+    const char* token = accept_encoding;
+    while (*token != '\0') {
+        while (*token == ' ' || *token == ',') token++;
+        const char* token_end = token;
+        while (*token_end != '\0' && *token_end != ',') token_end++;
+        const bool is_match = strncasecmp(token, coding, coding_length) == 0 &&
+            (token[coding_length] == ';' || token[coding_length] == ',' || token[coding_length] == ' ' || token[coding_length] == '\0');
+        if (is_match) {
+            const char* quality = strstr(token, "q=");
+            const bool is_disabled = quality != NULL && quality < token_end && strtof(quality+2, NULL) == 0.0f;
+            return !is_disabled;
         }
+        token = token_end;
     }
-    fclose(fd);
-    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_send_chunk(request, NULL, 0));
-    return is_success ? ESP_OK : ESP_FAIL;
+    return false;
 }
 
-static const char SPIFFS_ROOT_PATH[] = "";
-static esp_vfs_spiffs_conf_t spiffs_config = {
-  .base_path = SPIFFS_ROOT_PATH,
-  .partition_label = NULL,
-  .max_files = 12,
-  .format_if_mount_failed = true,
-};
+static const struct EndpointVariant* select_endpoint_variant(httpd_req_t *request, const struct EndpointFile* file) {
+    // a corrupted compressed copy falls back to the original
+    if (!has_gzip_variant(file) || !is_variant_healthy(&file->gzip)) return &file->identity;
+    // truncated headers still hold the codings that fit
+    char* accept_encoding = (char *)SCRATCH_BUFFER;
+    const esp_err_t status = httpd_req_get_hdr_value_str(request, "Accept-Encoding", accept_encoding, SCRATCH_BUFFER_SIZE);
+    if (status != ESP_OK && status != ESP_ERR_HTTPD_RESULT_TRUNC) return &file->identity;
+    return is_encoding_accepted(accept_encoding, "gzip") ? &file->gzip : &file->identity;
+}
 
-static esp_err_t init_spiffs(void) {
-    // Use settings defined above to initialize and mount SPIFFS filesystem.
-    // Note: esp_vfs_spiffs_register is an all-in-one convenience function.
-    const esp_err_t spiffs_register_status = esp_vfs_spiffs_register(&spiffs_config);
-    switch (spiffs_register_status) {
-    case ESP_OK:   
-        ESP_LOGI(TAG, "initialising spiffs filesystem"); 
-        break;
-    case ESP_FAIL: 
-        ESP_LOGE(TAG, "failed to mount or format spiffs filesystem"); 
-        break;
-    case ESP_ERR_NOT_FOUND: 
-        ESP_LOGE(TAG, "failed to find spiffs partition");
-        break;
-    default:
-        ESP_LOGE(TAG, "failed to initialize spiffs (%s)", esp_err_to_name(spiffs_register_status));
-        break;
-    }
-    if (spiffs_register_status != ESP_OK) {
-        return ESP_FAIL;
+// reads the whole file into a new cache entry, NULL if it couldn't be cached
+static const struct AssetCacheEntry* load_cached_file(const struct EndpointVariant* file) {
+    struct AssetCacheEntry* entry = asset_cache_insert(&ASSET_CACHE, (const uint8_t*)file->sha1, file->file_size);
+    if (entry == NULL) return NULL;
+    const esp_err_t read_status = asset_bundle_read(&ASSET_BUNDLE, file->data_offset, entry->data, entry->size);
+    if (read_status != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to cache %u bytes at offset %u (%s)", file->file_size, file->data_offset, esp_err_to_name(read_status));
+        asset_cache_remove(&ASSET_CACHE, entry);
+        return NULL;
     }
+    ESP_LOGD(TAG, "cached %u bytes at offset %u, used=%u/%u bytes", file->file_size, file->data_offset, ASSET_CACHE.used, ASSET_CACHE.budget);
+    return entry;
+}
 
-    size_t total = 0, used = 0;
-    const esp_err_t spiffs_info_status = esp_spiffs_info(NULL, &total, &used);
-    if (spiffs_info_status == ESP_OK) {
-        ESP_LOGI(TAG, "got spiffs partition size: total=%d, used=%d", total, used);
-        return ESP_OK;
-    } else {
-        ESP_LOGE(TAG, "failed to get spiffs partition information (%s)", esp_err_to_name(spiffs_info_status));
+// part of a file that is sent, the whole file unless a single range was requested
+struct ByteRange {
+    size_t offset;
+    size_t length;
+};
+
+// ESP_ERR_NOT_FOUND if the file has to be streamed from flash instead
+static esp_err_t send_cached_file(httpd_req_t *request, const struct EndpointVariant* file, const struct ByteRange* range) {
+    const struct AssetCacheEntry* entry = asset_cache_get(&ASSET_CACHE, (const uint8_t*)file->sha1);
+    if (entry == NULL) {
+        entry = load_cached_file(file);
+        if (entry == NULL) return ESP_ERR_NOT_FOUND;
+    }
+    const esp_err_t send_status = httpd_resp_send(request, (const char *)&entry->data[range->offset], range->length);
+    if (send_status != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to send cached file for uri='%s' due to error '%s'", request->uri, esp_err_to_name(send_status));
         return ESP_FAIL;
     }
+    return ESP_OK;
 }
 
-static struct EndpointFile* read_endpoint_from_line(char *line) {
-    if (line == NULL) return NULL;
-    static const char* DELIMITERS = ",\n";
-    static const size_t EXPECTED_TOKENS = 4;
-    const char* tokens[EXPECTED_TOKENS];
+struct StreamBlock {
+    uint8_t* data;
+    size_t length;
+    size_t total_sent;
+};
 
-    size_t total_tokens = 0;
-    char* token = strtok(line, DELIMITERS);
-    while (token != NULL) {
-        tokens[total_tokens] = token;
-        total_tokens++;
-        if (total_tokens >= EXPECTED_TOKENS) break;
-        token = strtok(NULL, DELIMITERS);
+static size_t read_stream_block(struct StreamBlock* block, size_t* offset, size_t* remaining_bytes) {
+    const size_t block_size = *remaining_bytes < STREAM_BLOCK_SIZE ? *remaining_bytes : STREAM_BLOCK_SIZE;
+    block->length = 0;
+    block->total_sent = 0;
+    if (block_size == 0) return 0;
+    const esp_err_t read_status = asset_bundle_read(&ASSET_BUNDLE, *offset, block->data, block_size);
+    if (read_status != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read %u bytes at offset %u (%s)", block_size, *offset, esp_err_to_name(read_status));
+        return 0;
     }
+    block->length = block_size;
+    *offset += block_size;
+    *remaining_bytes -= block_size;
+    return block->length;
+}
 
-    if (total_tokens != EXPECTED_TOKENS) {
-        ESP_LOGE(TAG, "Failed to read endpoint from line: '%s'", line);
-        return NULL;
+// reads the next block into one buffer while the previous one is still waiting for room in the socket's send buffer
+// flash reads only stall the socket when it has already drained everything it was given
+static esp_err_t stream_file_blocks(httpd_req_t *request, size_t offset, size_t length) {
+    struct StreamBlock blocks[2] = {
+        { .data = STREAM_BUFFERS[0], .length = 0, .total_sent = 0 },
+        { .data = STREAM_BUFFERS[1], .length = 0, .total_sent = 0 },
+    };
+    struct StreamBlock* front = &blocks[0];
+    struct StreamBlock* back = &blocks[1];
+    size_t remaining_bytes = length;
+
+    read_stream_block(front, &offset, &remaining_bytes);
+    while (front->length > 0) {
+        bool is_back_read = false;
+        while (front->total_sent < front->length) {
+            const char* data = (const char *)&front->data[front->total_sent];
+            const size_t data_length = front->length - front->total_sent;
+            const int total_sent = httpd_resp_try_send_stream_data(request, data, data_length);
+            if (total_sent < 0) {
+                ESP_LOGE(TAG, "Failed to stream block of size %u for uri='%s' due to error %d", data_length, request->uri, total_sent);
+                return ESP_FAIL;
+            }
+            front->total_sent += total_sent;
+            if (front->total_sent == front->length) break;
+            if (!is_back_read) {
+                read_stream_block(back, &offset, &remaining_bytes);
+                is_back_read = true;
+                continue;
+            }
+            // nothing left to do in the meantime so wait for the socket
+            const esp_err_t send_status = httpd_resp_send_stream_data(request, data + total_sent, data_length - total_sent);
+            if (send_status != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to stream block of size %u for uri='%s' due to error '%s'", data_length, request->uri, esp_err_to_name(send_status));
+                return ESP_FAIL;
+            }
+            front->total_sent = front->length;
+        }
+        if (!is_back_read) read_stream_block(back, &offset, &remaining_bytes);
+        struct StreamBlock* sent_block = front;
+        front = back;
+        back = sent_block;
     }
-
-    const char* filepath = tokens[0];
-    const char* file_size_str = tokens[1];
-    const char* mimetype = tokens[2];
-    const char* sha1_hash = tokens[3];
-    const size_t filepath_length = strlen(filepath)+sizeof(SPIFFS_ROOT_PATH)+1; // extend for prepending root directory
-    const size_t mimetype_length = strlen(mimetype);
-    const size_t sha1_hash_length = strlen(sha1_hash);
-
-    unsigned int file_size = 0;
-    if (sscanf(file_size_str, "%u", &file_size) != 1) {
-        ESP_LOGE(TAG, "Failed to convert file size string '%s' to integer", file_size_str);
-        return NULL;
+    if (remaining_bytes > 0) {
+        ESP_LOGE(TAG, "Failed to read file for uri='%s' with %u bytes left", request->uri, remaining_bytes);
+        return ESP_FAIL;
     }
+    return ESP_OK;
+}
 
-    struct EndpointFile* file = malloc(sizeof(struct EndpointFile));
-    file->filepath = malloc(filepath_length+1);
-    file->file_size = file_size;
-    file->mimetype = malloc(mimetype_length+1);
-    file->sha1_hash = malloc(sha1_hash_length+1);
+enum RangeRequest {
+    RANGE_REQUEST_NONE,
+    RANGE_REQUEST_PARTIAL,
+    RANGE_REQUEST_UNSATISFIABLE,
+};
 
-    if (file->filepath == NULL) goto error;
-    if (file->mimetype == NULL) goto error;
-    if (file->sha1_hash == NULL) goto error;
+// parses a decimal position, false if there are no digits
+static bool parse_range_position(const char** c, size_t* position) {
+    if (!isdigit((unsigned char)**c)) return false;
+    char* end = NULL;
+    *position = strtoul(*c, &end, 10);
+    *c = end;
+    return true;
+}
 
-    snprintf(file->filepath, filepath_length+1, "%s/%s", SPIFFS_ROOT_PATH, filepath);
-    snprintf(file->mimetype, mimetype_length+1, "%s", mimetype);
-    snprintf(file->sha1_hash, sha1_hash_length+1, "%s", sha1_hash);
+// only single ranges are supported, anything else is ignored and the whole file is sent
+// "bytes=first-last", "bytes=first-" and "bytes=-suffix_length"
+static enum RangeRequest parse_range_request(const char* value, size_t file_size, struct ByteRange* range) {
+    static const char BYTES_UNIT[] = "bytes=";
+    if (strncasecmp(value, BYTES_UNIT, sizeof(BYTES_UNIT)-1) != 0) return RANGE_REQUEST_NONE;
+    const char* c = value + sizeof(BYTES_UNIT)-1;
+    if (strchr(c, ',') != NULL) return RANGE_REQUEST_NONE;
+    while (*c == ' ') c++;
+
+    size_t first = 0;
+    size_t last = SIZE_MAX;
+    if (*c == '-') {
+        c++;
+        size_t suffix_length = 0;
+        if (!parse_range_position(&c, &suffix_length)) return RANGE_REQUEST_NONE;
+        if (suffix_length == 0 || file_size == 0) return RANGE_REQUEST_UNSATISFIABLE;
+        if (suffix_length > file_size) suffix_length = file_size;
+        first = file_size - suffix_length;
+    } else {
+        if (!parse_range_position(&c, &first)) return RANGE_REQUEST_NONE;
+        if (*c != '-') return RANGE_REQUEST_NONE;
+        c++;
+        if (isdigit((unsigned char)*c) && !parse_range_position(&c, &last)) return RANGE_REQUEST_NONE;
+        if (last < first) return RANGE_REQUEST_NONE;
+        if (first >= file_size) return RANGE_REQUEST_UNSATISFIABLE;
+    }
+    while (*c == ' ') c++;
+    if (*c != '\0') return RANGE_REQUEST_NONE;
 
-    return file;
-error:
-    free_endpoint(file);
-    return NULL;
+    if (last >= file_size) last = file_size-1;
+    range->offset = first;
+    range->length = last - first + 1;
+    return RANGE_REQUEST_PARTIAL;
 }
 
-static esp_err_t add_endpoints(httpd_handle_t server) {
-    DIR *dir = opendir(SPIFFS_ROOT_PATH);
-    if (dir == NULL) {
-        ESP_LOGE(TAG, "failed to open spiffs folder: '%s'", SPIFFS_ROOT_PATH);
-        return ESP_FAIL;
+// a range is only sent if If-Range is missing or holds the current strong etag, otherwise the client needs the whole file
+static bool is_range_current(httpd_req_t *request, const struct EndpointVariant* file) {
+    const esp_err_t status = httpd_req_get_hdr_value_str(request, "If-Range", (char *)SCRATCH_BUFFER, SCRATCH_BUFFER_SIZE);
+    if (status == ESP_ERR_NOT_FOUND) return true;
+    if (status != ESP_OK || !is_variant_healthy(file)) return false;
+    const char* if_range = (const char *)SCRATCH_BUFFER;
+    // weak tags and dates never match
+    if (strncmp(if_range, "W/", 2) == 0) return false;
+    return is_etag_matched(if_range, file->sha1);
+}
+
+static esp_err_t send_endpoint_file(httpd_req_t *request, const struct EndpointFile* endpoint) {
+    const struct EndpointVariant* file = select_endpoint_variant(request, endpoint);
+    // the indexed etag doesn't describe what's in flash, so neither browsers nor the RAM cache may keep it
+    const bool is_healthy = is_variant_healthy(file);
+
+    // SOURCE: https://devdojo.com/vnnvanhuong/demo-http-caching-with-etag
+    // Support file caching
+    bool is_cache = false;
+    // browsers can send a list of tags, the tags that fit in a truncated header are still checked
+    const esp_err_t etag_status = is_healthy ?
+        httpd_req_get_hdr_value_str(request, "If-None-Match", (char *)SCRATCH_BUFFER, SCRATCH_BUFFER_SIZE) :
+        ESP_ERR_NOT_FOUND;
+    if (etag_status == ESP_OK || etag_status == ESP_ERR_HTTPD_RESULT_TRUNC) {
+        is_cache = is_etag_matched((char *)SCRATCH_BUFFER, file->sha1);
+        if (!is_cache) {
+            ESP_LOGD(TAG, "cache miss: if_none_match='%s', uri='%s'", (char *)SCRATCH_BUFFER, request->uri);
+        }
+    } else if (etag_status != ESP_ERR_NOT_FOUND) {
+        ESP_LOGE(TAG, "request contained malformed 'If-None-Match' etag (%s), uri='%s'", esp_err_to_name(etag_status), request->uri);
     }
 
-    char* FILEPATH = (char*)SCRATCH_BUFFER;
-    const size_t MAX_FILEPATH_LENGTH = SCRATCH_BUFFER_SIZE;
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_type(request, endpoint->mimetype));
+    if (is_healthy) {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_hdr_block(request, file->headers, file->headers_length));
+    } else {
+        // only the identity variant is served when unhealthy so there is no Content-Encoding
+        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_hdr(request, "Cache-Control", "no-store"));
+        if (has_gzip_variant(endpoint)) {
+            ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_hdr(request, "Vary", "Accept-Encoding"));
+        }
+    }
+    if (is_cache) {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_status(request, "304 Not Modified"));
+        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_send(request, NULL, 0));
+        return ESP_OK;
+    }
 
-    ESP_LOGI(TAG, "listing spiffs files");
-    struct stat file_stat;
-    while (true) {
-        struct dirent *entry = readdir(dir);
-        if (entry == NULL) break;
-        snprintf(FILEPATH, MAX_FILEPATH_LENGTH, "%s/%s", SPIFFS_ROOT_PATH, entry->d_name);
-        if (stat(FILEPATH, &file_stat) == -1) {
-            ESP_LOGI(TAG, "- name=%s (stat_failed)", FILEPATH);
-            continue;
+    // resume interrupted downloads by sending only the requested range
+    struct ByteRange range = { .offset = 0, .length = file->file_size };
+    // lives until the response is sent
+    char content_range[48];
+    const esp_err_t range_status = httpd_req_get_hdr_value_str(request, "Range", (char *)SCRATCH_BUFFER, SCRATCH_BUFFER_SIZE);
+    if (range_status == ESP_OK) {
+        const enum RangeRequest range_request = parse_range_request((char *)SCRATCH_BUFFER, file->file_size, &range);
+        if (range_request == RANGE_REQUEST_UNSATISFIABLE) {
+            ESP_LOGD(TAG, "unsatisfiable range='%s' for size=%u, uri='%s'", (char *)SCRATCH_BUFFER, file->file_size, request->uri);
+            snprintf(content_range, sizeof(content_range), "bytes */%u", file->file_size);
+            ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_hdr(request, "Content-Range", content_range));
+            ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_status(request, "416 Range Not Satisfiable"));
+            ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_send(request, NULL, 0));
+            return ESP_OK;
         }
-        ESP_LOGI(TAG, "+ name=%s, size=%ld", FILEPATH, file_stat.st_size);
+        if (range_request == RANGE_REQUEST_PARTIAL && is_range_current(request, file)) {
+            snprintf(content_range, sizeof(content_range), "bytes %u-%u/%u", range.offset, range.offset + range.length - 1, file->file_size);
+            ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_hdr(request, "Content-Range", content_range));
+            ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_status(request, "206 Partial Content"));
+        } else {
+            range.offset = 0;
+            range.length = file->file_size;
+        }
+    } else if (range_status != ESP_ERR_NOT_FOUND) {
+        ESP_LOGE(TAG, "request contained malformed 'Range' (%s), uri='%s'", esp_err_to_name(range_status), request->uri);
+    }
+
+    if (!is_healthy) {
+        // the copy may have been cached before the verify task got to it
+        asset_cache_invalidate(&ASSET_CACHE, (const uint8_t*)file->sha1);
+    } else if (asset_cache_is_cacheable(&ASSET_CACHE, file->file_size)) {
+        const esp_err_t cached_status = send_cached_file(request, file, &range);
+        if (cached_status != ESP_ERR_NOT_FOUND) return cached_status;
     }
-    closedir(dir);
 
-    snprintf(FILEPATH, MAX_FILEPATH_LENGTH, "%s/%s", SPIFFS_ROOT_PATH, SERVER_FILES_FILEPATH);
-    FILE* fd = fopen(FILEPATH, "r");
-    if (fd == NULL) {
-        ESP_LOGE(TAG, "Failed to open webserver index file: %s", FILEPATH);
+    // stream the file, the size is known so blocks go out without chunked framing
+    const esp_err_t begin_status = httpd_resp_send_stream_begin(request, range.length);
+    if (begin_status != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to send headers for uri='%s' due to error '%s'", request->uri, esp_err_to_name(begin_status));
         return ESP_FAIL;
     }
+    const esp_err_t stream_status = stream_file_blocks(request, file->data_offset + range.offset, range.length);
+    // closes the connection if the body came up short
+    const esp_err_t end_status = httpd_resp_send_stream_end(request);
+    return (stream_status == ESP_OK && end_status == ESP_OK) ? ESP_OK : ESP_FAIL;
+}
 
-    char* LINE_BUFFER = (char*)SCRATCH_BUFFER;
-    const size_t MAX_LINE_BUFFER_SIZE = SCRATCH_BUFFER_SIZE;
-    fgets(LINE_BUFFER, MAX_LINE_BUFFER_SIZE, fd); // skip csv header line
+// NULL if the path isn't in the bundle
+static const struct EndpointFile* find_endpoint(const char* path) {
+    const uint32_t path_hash = asset_bundle_hash_path(path);
+    size_t low = 0;
+    size_t high = TOTAL_ENDPOINTS;
+    while (low < high) {
+        const size_t middle = low + (high - low)/2;
+        if (ENDPOINTS[middle].path_hash < path_hash) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    for (size_t i = low; i < TOTAL_ENDPOINTS && ENDPOINTS[i].path_hash == path_hash; i++) {
+        if (strcmp(ENDPOINTS[i].uri, path) == 0) return &ENDPOINTS[i];
+    }
+    return NULL;
+}
+
+// single handler for every static file, registered last behind the api endpoints
+static esp_err_t handle_static_file_request(httpd_req_t *request) {
+    assert(request != NULL);
     static const char INDEX_FILEPATH[] = "/index.html";
+    // longer paths can't be in the bundle
+    char path[ASSET_BUNDLE_MAX_PATH_LENGTH];
+    const size_t path_length = strcspn(request->uri, "?#");
+    if (path_length >= sizeof(path)) {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_send_err(request, HTTPD_404_NOT_FOUND, "File not found"));
+        return ESP_OK;
+    }
+    memcpy(path, request->uri, path_length);
+    path[path_length] = '\0';
 
-    size_t total_registered_endpoints = 0;
-    while (true) {
-        if (fgets(LINE_BUFFER, MAX_LINE_BUFFER_SIZE, fd) == NULL) {
-            break;
-        }
-        struct EndpointFile* endpoint = read_endpoint_from_line(LINE_BUFFER);
-        if (endpoint == NULL) continue;
+    const bool is_root = path_length == 1 && path[0] == '/';
+    const struct EndpointFile* endpoint = find_endpoint(is_root ? INDEX_FILEPATH : path);
+    if (endpoint == NULL) {
+        ESP_LOGD(TAG, "no static file for uri='%s'", request->uri);
+        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_send_err(request, HTTPD_404_NOT_FOUND, "File not found"));
+        return ESP_OK;
+    }
+    return send_endpoint_file(request, endpoint);
+}
+
+static void read_endpoint_variant(struct EndpointVariant* variant, const struct AssetBundleEntry* entry) {
+    variant->data_offset = entry->data_offset;
+    variant->file_size = entry->data_length;
+    memcpy(variant->sha1, entry->sha1, ASSET_BUNDLE_SHA1_SIZE);
+    variant->headers = asset_bundle_get_headers(&ASSET_BUNDLE, entry);
+    variant->headers_length = entry->header_length;
+}
 
-        if (stat(endpoint->filepath, &file_stat) == -1) {
-            ESP_LOGE(TAG, "Failed to get file stat for '%s'", endpoint->filepath);
-            free_endpoint(endpoint);
+static struct EndpointFile* read_endpoint_from_entry(const struct AssetBundleEntry* entry) {
+    const char* path = asset_bundle_get_path(&ASSET_BUNDLE, entry);
+    if (path == NULL) {
+        ESP_LOGE(TAG, "Bundle entry has an invalid path at offset %u", entry->path_offset);
+        return NULL;
+    }
+    assert(TOTAL_ENDPOINTS < ASSET_BUNDLE.header.total_entries);
+    if (TOTAL_ENDPOINTS > 0 && ENDPOINTS[TOTAL_ENDPOINTS-1].path_hash > entry->path_hash) {
+        ESP_LOGE(TAG, "Bundle entry for '%s' is out of order", path);
+        return NULL;
+    }
+    struct EndpointFile* file = &ENDPOINTS[TOTAL_ENDPOINTS++];
+    file->uri = path;
+    file->path_hash = entry->path_hash;
+    file->mimetype = asset_bundle_get_mimetype(entry->mime_id);
+    file->has_gzip = false;
+    read_endpoint_variant(&file->identity, entry);
+    return file;
+}
+
+static esp_err_t load_endpoints(void) {
+    const size_t total_entries = ASSET_BUNDLE.header.total_entries;
+
+    // sized for the worst case of one endpoint per entry, the unused tail is a few records at most
+    ENDPOINTS = calloc(total_entries, sizeof(struct EndpointFile));
+    if (ENDPOINTS == NULL && total_entries > 0) {
+        ESP_LOGE(TAG, "Failed to allocate %u endpoint records", total_entries);
+        return ESP_ERR_NO_MEM;
+    }
+    TOTAL_ENDPOINTS = 0;
+
+    struct AssetBundleEntry entry;
+    struct AssetBundleEntry next_entry;
+    char sha1_hash[SHA1_HEX_LENGTH+1];
+    for (size_t index = 0; index < total_entries; index++) {
+        if (asset_bundle_read_entry(&ASSET_BUNDLE, index, &entry) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read bundle entry %u", index);
             continue;
         }
-
-        if ((off_t)endpoint->file_size != file_stat.st_size) {
-            ESP_LOGE(TAG, "Mismatch in indexed file size (%u) and actual file size (%ld) for '%s'", endpoint->file_size, file_stat.st_size, endpoint->filepath);
-            free_endpoint(endpoint);
+        if (entry.encoding != ASSET_ENCODING_IDENTITY) {
+            ESP_LOGW(TAG, "Skipping bundle entry %u with encoding %u and no identity variant", index, entry.encoding);
             continue;
         }
+        struct EndpointFile* endpoint = read_endpoint_from_entry(&entry);
+        if (endpoint == NULL) continue;
 
-        httpd_uri_t uri_handler = {
-            .uri = endpoint->filepath,
-            .method = HTTP_GET,
-            .handler = handle_endpoint_file_request,
-            .user_ctx = (void *)endpoint,
-            .is_websocket = false,
-            .handle_ws_control_frames = false,
-            .supported_subprotocol = NULL,
-        };
-        {
-            const esp_err_t status = httpd_register_uri_handler(server, &uri_handler);
-            if (status == ESP_OK) {
-                ESP_LOGI(TAG,
-                    "registered endpoint: uri='%s', size=%u, mimetype=%s, sha1_hash=%s",
-                    uri_handler.uri, endpoint->file_size, endpoint->mimetype, endpoint->sha1_hash
-                );
-                total_registered_endpoints++;
-            } else {
-                ESP_LOGE(TAG,
-                    "failed to register endpoint: uri='%s', size=%u, mimetype=%s, sha1_hash=%s, error=%s",
-                    uri_handler.uri, endpoint->file_size, endpoint->mimetype, endpoint->sha1_hash, esp_err_to_name(status)
-                );
-            }
+        // the gzip variant follows the identity variant of the same path
+        const bool has_next_entry = index+1 < total_entries && asset_bundle_read_entry(&ASSET_BUNDLE, index+1, &next_entry) == ESP_OK;
+        if (has_next_entry && next_entry.path_offset == entry.path_offset && next_entry.encoding == ASSET_ENCODING_GZIP) {
+            index++;
+            read_endpoint_variant(&endpoint->gzip, &next_entry);
+            endpoint->has_gzip = true;
         }
-        const bool is_index_file = strncmp(endpoint->filepath, INDEX_FILEPATH, sizeof(INDEX_FILEPATH)) == 0;
-        if (is_index_file) {
-            uri_handler.uri = "/";
-            const esp_err_t status = httpd_register_uri_handler(server, &uri_handler);
-            if (status == ESP_OK) {
-                ESP_LOGI(TAG, "registered '%s' to '/'", INDEX_FILEPATH);
-                total_registered_endpoints++;
-            } else {
-                ESP_LOGE(TAG, "failed to register '%s' to '/'", INDEX_FILEPATH);
-            }
+        format_sha1_hex((const uint8_t*)endpoint->identity.sha1, sha1_hash);
+        ESP_LOGI(TAG,
+            "loaded endpoint: uri='%s', size=%u, gzip_size=%u, mimetype=%s, sha1_hash=%s",
+            endpoint->uri, endpoint->identity.file_size, endpoint->gzip.file_size, endpoint->mimetype, sha1_hash
+        );
+    }
+    return ESP_OK;
+}
+
+// hashes the variant's data in the bundle, block holds VERIFY_BLOCK_SIZE bytes
+static esp_err_t hash_variant(const struct EndpointVariant* variant, uint8_t* block, uint32_t* digest) {
+    mbedtls_sha1_context context;
+    mbedtls_sha1_init(&context);
+    int sha1_status = mbedtls_sha1_starts_ret(&context);
+    esp_err_t read_status = ESP_OK;
+    size_t offset = variant->data_offset;
+    size_t remaining_bytes = variant->file_size;
+    while (sha1_status == 0 && remaining_bytes > 0) {
+        const size_t block_size = remaining_bytes < VERIFY_BLOCK_SIZE ? remaining_bytes : VERIFY_BLOCK_SIZE;
+        read_status = asset_bundle_read(&ASSET_BUNDLE, offset, block, block_size);
+        if (read_status != ESP_OK) break;
+        sha1_status = mbedtls_sha1_update_ret(&context, block, block_size);
+        offset += block_size;
+        remaining_bytes -= block_size;
+    }
+    if (sha1_status == 0 && read_status == ESP_OK) {
+        sha1_status = mbedtls_sha1_finish_ret(&context, (unsigned char*)digest);
+    }
+    mbedtls_sha1_free(&context);
+    if (read_status != ESP_OK) return read_status;
+    return sha1_status == 0 ? ESP_OK : ESP_FAIL;
+}
+
+static void verify_variant(const struct EndpointFile* endpoint, struct EndpointVariant* variant, uint8_t* block) {
+    uint32_t digest[ASSET_BUNDLE_SHA1_SIZE/sizeof(uint32_t)];
+    const int64_t start_us = esp_timer_get_time();
+    const esp_err_t status = hash_variant(variant, block, digest);
+    STATS.hash_time_us += (uint32_t)(esp_timer_get_time() - start_us);
+    STATS.hashed_bytes += variant->file_size;
+    if (status == ESP_OK && is_sha1_equal(digest, variant->sha1)) {
+        variant->health = ASSET_HEALTH_VERIFIED;
+        STATS.verified_assets++;
+        return;
+    }
+    variant->health = ASSET_HEALTH_UNHEALTHY;
+    STATS.unhealthy_assets++;
+    ESP_LOGE(TAG,
+        "asset failed verification and is served uncached: uri='%s', size=%u, offset=%u, status=%s",
+        endpoint->uri, variant->file_size, variant->data_offset, esp_err_to_name(status)
+    );
+}
+
+// runs once at low priority after the handler is registered, requests are served while it hashes
+static void verify_endpoints_task(void* arg) {
+    uint8_t* block = malloc(VERIFY_BLOCK_SIZE);
+    if (block == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes to verify assets", VERIFY_BLOCK_SIZE);
+        vTaskDelete(NULL);
+        return;
+    }
+    for (size_t i = 0; i < TOTAL_ENDPOINTS; i++) {
+        struct EndpointFile* endpoint = &ENDPOINTS[i];
+        verify_variant(endpoint, &endpoint->identity, block);
+        if (endpoint->has_gzip) {
+            verify_variant(endpoint, &endpoint->gzip, block);
         }
+        // hashing never blocks so give the idle task a turn between files
+        vTaskDelay(1);
     }
-    fclose(fd);
+    free(block);
+    ESP_LOGI(TAG,
+        "verified assets: total=%u, unhealthy=%u, hashed_bytes=%u, hash_time_us=%u",
+        STATS.verified_assets + STATS.unhealthy_assets, STATS.unhealthy_assets, STATS.hashed_bytes, STATS.hash_time_us
+    );
+    vTaskDelete(NULL);
+}
 
-    ESP_LOGI(TAG, "Registered %u endpoints to httpd server", total_registered_endpoints);
+static esp_err_t add_endpoints(httpd_handle_t server) {
+    const esp_err_t load_status = load_endpoints();
+    if (load_status != ESP_OK) return load_status;
+
+    // matches any path so it has to come after every other handler
+    const httpd_uri_t uri_handler = {
+        .uri = "/*",
+        .method = HTTP_GET,
+        .handler = handle_static_file_request,
+        .user_ctx = NULL,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = NULL,
+    };
+    const esp_err_t status = httpd_register_uri_handler(server, &uri_handler);
+    if (status != ESP_OK) {
+        ESP_LOGE(TAG, "failed to register static file handler: uri='%s', error=%s", uri_handler.uri, esp_err_to_name(status));
+        return status;
+    }
+    ESP_LOGI(TAG, "Registered static file handler for %u endpoints to httpd server", TOTAL_ENDPOINTS);
     return ESP_OK;
 }
 
 esp_err_t webserver_register_endpoints(httpd_handle_t server) {
     assert(server != NULL);
-    if (init_spiffs() != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read files from spiffs partition");
+    asset_cache_init(&ASSET_CACHE, CONFIG_WEBSERVER_CACHE_SIZE, CONFIG_WEBSERVER_CACHE_MAX_FILE_SIZE);
+    if (asset_bundle_open(&ASSET_BUNDLE, ASSET_BUNDLE_PARTITION_LABEL) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open static file bundle");
         return ESP_FAIL;
     }
     if (add_endpoints(server) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to create webserver endpoints");
         return ESP_FAIL;
     }
+    // files stay servable without verification, they just aren't checked
+    if (xTaskCreate(verify_endpoints_task, "asset-verify-task", VERIFY_TASK_STACK_SIZE, NULL, VERIFY_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start asset verify task");
+    }
     return ESP_OK;
 }
+
+void webserver_get_stats(struct WebserverStats* stats) {
+    assert(stats != NULL);
+    *stats = STATS;
+    stats->hash_bytes_per_ms = stats->hash_time_us > 0 ? (uint32_t)((uint64_t)stats->hashed_bytes*1000 / stats->hash_time_us) : 0;
+    stats->cache_hits = ASSET_CACHE.stats.hits;
+    stats->cache_misses = ASSET_CACHE.stats.misses;
+    stats->cache_evictions = ASSET_CACHE.stats.evictions;
+}
@@ -6,35 +6,129 @@
 
 // basic websocket implementation that keeps track of clients
 struct Websocket;
+struct WebsocketBroadcastEntry;
+
+// corked frames are packed into a per client buffer that fits this many full sized frames
+#define WEBSOCKET_MAX_CORKED_FRAMES 4
+// server frames are unmasked and payloads are below 64KiB so the header is at most 4 bytes
+#define WEBSOCKET_MAX_FRAME_HEADER_SIZE 4
+
+// entries for queued async tasks and broadcasts are taken from fixed pools, work is dropped when they run out
+#define WEBSOCKET_MAX_QUEUED_TASKS 8
+#define WEBSOCKET_MAX_QUEUED_BROADCASTS 4
+
+// topics are bits in a client's subscription mask
+#define WEBSOCKET_MAX_TOPICS 8
+
+// websocket_fd of client table slots that don't hold a client
+#define WEBSOCKET_SLOT_EMPTY -1
+#define WEBSOCKET_SLOT_DELETED -2
 
 struct WebsocketClient {
     struct Websocket* websocket;
     int websocket_fd;
-    struct WebsocketClient* next_client;
+    // changes every time the slot is given to a new connection
+    uint32_t generation;
+    // payload of the next frame, owned by the client so sends to different clients don't share it
+    uint8_t* transmit_buffer;
+    // batching of outgoing frames
+    uint8_t* cork_buffer;
+    size_t cork_length;
+    int cork_depth;
+    // bit n is set when subscribed to topic n
+    uint8_t subscriptions;
+};
+
+// refers to a client without keeping its slot alive, resolves to NULL once that connection closed
+struct WebsocketClientHandle {
+    int websocket_fd;
+    uint32_t generation;
+};
+
+// fixed size entries linked through their first word while free
+// taken from any task so the list is guarded by a critical section
+struct WebsocketEntryPool {
+    uint8_t* entries;
+    void* free_entries;
+    size_t entry_size;
+    // most entries taken at once, shows how close bursts come to dropping work
+    size_t total_taken;
+    size_t max_taken;
+};
+
+// counters for benchmarking, only updated from the httpd task except for queue_drops and coalesced
+struct WebsocketStats {
+    uint32_t rx_frames;
+    uint32_t rx_bytes;
+    uint32_t tx_frames;
+    uint32_t tx_bytes;
+    uint32_t tx_drops;
+    uint32_t queue_drops;
+    uint32_t stale_tasks;
+    uint32_t coalesced;
 };
 
 struct Websocket {
-    // buffers
-    size_t receive_buffer_size;
+    // transmit buffers, received frames are read in place from the httpd scratch buffer
     size_t transmit_buffer_size;
-    uint8_t* receive_buffer;
-    uint8_t* transmit_buffer;
+    size_t cork_buffer_size;
     // handles
     const char* uri;
     httpd_handle_t server;
+    // open addressed table indexed by fd, clients never move so pointers stay valid until closed
     struct WebsocketClient* clients;
+    size_t max_clients;
+    size_t total_clients;
+    uint32_t next_generation;
+    uint8_t* client_buffers;
+    // subscriber count per topic so producers can skip unwatched topics
+    uint8_t topic_subscribers[WEBSOCKET_MAX_TOPICS];
+    // queued publish per topic that hasn't run yet, guarded by a critical section
+    struct WebsocketBroadcastEntry* topic_mailbox[WEBSOCKET_MAX_TOPICS];
+    struct WebsocketEntryPool task_pool;
+    struct WebsocketEntryPool broadcast_pool;
+    struct WebsocketStats stats;
     // callbacks
     void (*on_binary_frame)(httpd_req_t* request, struct WebsocketClient* client, const uint8_t* data, size_t size);
     void (*on_open)(httpd_req_t* request, struct WebsocketClient* client);
-    // client will be freed after this call
+    // called for a close frame, the client slot is released once httpd deletes the session
     void (*on_close)(httpd_req_t* request, struct WebsocketClient* client);
 };
 
-esp_err_t websocket_register(httpd_handle_t server, struct Websocket* websocket, size_t buffer_size);
+// max_clients should match httpd_config_t.max_open_sockets
+esp_err_t websocket_register(httpd_handle_t server, struct Websocket* websocket, size_t buffer_size, size_t max_clients);
 size_t websocket_count_total_clients(struct Websocket* websocket);
 esp_err_t websocket_send_pending_binary_data_sync(struct WebsocketClient* client, httpd_req_t* request, size_t size);
 esp_err_t websocket_send_pending_binary_data_async(struct WebsocketClient* client, size_t size);
 
+// while corked, frames sent to the client are packed into one buffer and written together on the last uncork
+// cork/uncork pairs can be nested and must be called from the httpd task
+void websocket_cork(struct WebsocketClient* client);
+esp_err_t websocket_uncork(struct WebsocketClient* client);
+
+// encodes the frame once and writes it to every client accepted by the filter (all clients if NULL)
+// safe to call from any task, clients whose socket can't take the frame without blocking are skipped
+// filter_args must stay valid until the broadcast has run on the httpd task
+typedef bool (*websocket_client_filter_t)(struct WebsocketClient* client, void* args);
+esp_err_t websocket_broadcast(struct Websocket* websocket, const uint8_t* data, size_t size, websocket_client_filter_t filter, void* filter_args);
+
+// subscriptions are changed from the httpd task and are dropped when the client closes
+esp_err_t websocket_subscribe(struct WebsocketClient* client, uint8_t topic);
+esp_err_t websocket_unsubscribe(struct WebsocketClient* client, uint8_t topic);
+bool websocket_is_subscribed(const struct WebsocketClient* client, uint8_t topic);
+size_t websocket_count_topic_subscribers(const struct Websocket* websocket, uint8_t topic);
+// broadcasts to the topic's subscribers except for exclude (may be NULL), does nothing without subscribers
+// exclude is kept by handle so it only skips that connection, not a later client in the same slot
+// latest value wins: while a publish to the topic is still queued, a new one replaces its payload and exclude
+// safe to call from any task
+esp_err_t websocket_publish(struct Websocket* websocket, uint8_t topic, const uint8_t* data, size_t size, const struct WebsocketClient* exclude);
+
+struct WebsocketClientHandle websocket_get_client_handle(const struct WebsocketClient* client);
+// only valid on the httpd task until the next time it deletes a websocket session
+struct WebsocketClient* websocket_resolve_client_handle(struct Websocket* websocket, struct WebsocketClientHandle handle);
+
+// the task keeps a handle to the client and is skipped if the client closed before it runs
+// so args must not own anything that the task is expected to release
 typedef void (*websocket_async_task_t)(struct WebsocketClient* client, void* args);
 esp_err_t websocket_queue_async_task(struct WebsocketClient* client, websocket_async_task_t task, void* args);
 
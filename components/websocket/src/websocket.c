@@ -1,63 +1,219 @@
 #include "websocket.h"
 #include <esp_err.h>
 #include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <string.h>
+#include <sys/socket.h>
 
 static const char TAG[] = "websocket";
 
+struct WebsocketAsyncTaskEntry {
+    struct Websocket* websocket;
+    struct WebsocketClientHandle client;
+    websocket_async_task_t task;
+    void* args;
+};
+
+struct WebsocketBroadcastEntry {
+    struct Websocket* websocket;
+    websocket_client_filter_t filter;
+    void* filter_args;
+    uint8_t topic_mask; // 0 to send regardless of subscriptions
+    int8_t mailbox_topic; // -1 unless this is the pending entry of a topic's mailbox
+    // a handle so a client that closed and had its slot reused isn't skipped by mistake
+    struct WebsocketClientHandle exclude;
+    size_t payload_size;
+    size_t frame_size;
+    uint8_t frame[];
+};
+
+static void websocket_entry_pool_init(struct WebsocketEntryPool* pool, size_t entry_size, size_t total_entries) {
+    assert(pool != NULL);
+    // keep entries aligned for the pointer stored in free ones
+    entry_size = (entry_size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    pool->entries = malloc(entry_size*total_entries);
+    assert(pool->entries != NULL);
+    pool->entry_size = entry_size;
+    pool->free_entries = NULL;
+    pool->total_taken = 0;
+    pool->max_taken = 0;
+    for (size_t i = 0; i < total_entries; i++) {
+        void* entry = &(pool->entries[i*entry_size]);
+        *(void**)entry = pool->free_entries;
+        pool->free_entries = entry;
+    }
+}
+
+// the lx106 has no compare and swap so the list is guarded by a short critical section instead
+static void* websocket_entry_pool_take(struct WebsocketEntryPool* pool) {
+    taskENTER_CRITICAL();
+    void* entry = pool->free_entries;
+    if (entry != NULL) {
+        pool->free_entries = *(void**)entry;
+        pool->total_taken++;
+        if (pool->total_taken > pool->max_taken) pool->max_taken = pool->total_taken;
+    }
+    taskEXIT_CRITICAL();
+    return entry;
+}
+
+static void websocket_entry_pool_give(struct WebsocketEntryPool* pool, void* entry) {
+    assert(entry != NULL);
+    taskENTER_CRITICAL();
+    *(void**)entry = pool->free_entries;
+    pool->free_entries = entry;
+    pool->total_taken--;
+    taskEXIT_CRITICAL();
+}
+
+static void websocket_count_queue_drop(struct Websocket* websocket) {
+    taskENTER_CRITICAL();
+    websocket->stats.queue_drops++;
+    taskEXIT_CRITICAL();
+}
+
+static size_t get_websocket_client_slot(struct Websocket* websocket, int websocket_fd) {
+    return (size_t)websocket_fd % websocket->max_clients;
+}
+
+static void remove_websocket_client(struct Websocket* websocket, struct WebsocketClient* client);
+
 static struct WebsocketClient* add_websocket_client(struct Websocket* websocket, int websocket_fd) {
     assert(websocket != NULL);
-    struct WebsocketClient** head = &(websocket->clients);
-    while (*head != NULL) {
-        if ((*head)->websocket_fd == websocket_fd) {
-            ESP_LOGE(TAG, "Tried to add websocket client with fd=%d again", websocket_fd);
-            return NULL;
+    assert(websocket_fd >= 0);
+    struct WebsocketClient* free_client = NULL;
+    size_t slot = get_websocket_client_slot(websocket, websocket_fd);
+    for (size_t i = 0; i < websocket->max_clients; i++) {
+        struct WebsocketClient* client = &(websocket->clients[slot]);
+        if (client->websocket_fd == websocket_fd) {
+            // the socket closed without a close frame and lwip handed out its fd again
+            ESP_LOGW(TAG, "Replacing stale websocket client with fd=%d", websocket_fd);
+            remove_websocket_client(websocket, client);
         }
-        head = &((*head)->next_client);
+        if (client->websocket_fd < 0 && free_client == NULL) {
+            free_client = client;
+        }
+        // fd can't be further along the probe sequence
+        if (client->websocket_fd == WEBSOCKET_SLOT_EMPTY) break;
+        slot = (slot+1) % websocket->max_clients;
     }
 
-    struct WebsocketClient* client = malloc(sizeof(struct WebsocketClient));
-    assert(client != NULL);
-    client->websocket = websocket;
-    client->websocket_fd = websocket_fd;
-    client->next_client = NULL;
-    *head = client;
-    return client;
+    if (free_client == NULL) {
+        ESP_LOGE(TAG, "No free slot for websocket client with fd=%d, max_clients=%u", websocket_fd, websocket->max_clients);
+        return NULL;
+    }
+    free_client->websocket_fd = websocket_fd;
+    free_client->generation = websocket->next_generation++;
+    free_client->cork_length = 0;
+    free_client->cork_depth = 0;
+    free_client->subscriptions = 0;
+    websocket->total_clients++;
+    return free_client;
 }
 
-static struct WebsocketClient* pop_websocket_client(struct Websocket* websocket, int websocket_fd) {
-    assert(websocket != NULL);
-    struct WebsocketClient** head = &(websocket->clients);
-    while (*head != NULL) {
-        struct WebsocketClient* client = *head;
-        if (client->websocket_fd == websocket_fd) {
-            *head = client->next_client;
-            client->next_client = NULL;
-            return client;
+// a deleted slot only has to stay a tombstone while a probe sequence continues past it
+// once the slot after it is empty the run of tombstones ending here can become empty again
+static void clear_websocket_tombstones(struct Websocket* websocket, size_t slot) {
+    const size_t max_clients = websocket->max_clients;
+    if (websocket->total_clients == 0) {
+        for (size_t i = 0; i < max_clients; i++) {
+            websocket->clients[i].websocket_fd = WEBSOCKET_SLOT_EMPTY;
         }
-        head = &((*head)->next_client);
+        return;
+    }
+    const size_t next_slot = (slot+1) % max_clients;
+    if (websocket->clients[next_slot].websocket_fd != WEBSOCKET_SLOT_EMPTY) return;
+    for (size_t i = 0; i < max_clients; i++) {
+        struct WebsocketClient* client = &(websocket->clients[slot]);
+        if (client->websocket_fd != WEBSOCKET_SLOT_DELETED) break;
+        client->websocket_fd = WEBSOCKET_SLOT_EMPTY;
+        slot = (slot + max_clients - 1) % max_clients;
     }
-    return NULL;
+}
+
+static void remove_websocket_client(struct Websocket* websocket, struct WebsocketClient* client) {
+    assert(websocket != NULL);
+    assert(client != NULL);
+    assert(client->websocket_fd >= 0);
+    for (uint8_t topic = 0; topic < WEBSOCKET_MAX_TOPICS; topic++) {
+        if (websocket_is_subscribed(client, topic)) websocket_unsubscribe(client, topic);
+    }
+    // keep probe sequences through this slot intact
+    client->websocket_fd = WEBSOCKET_SLOT_DELETED;
+    client->cork_length = 0;
+    client->cork_depth = 0;
+    websocket->total_clients--;
+    clear_websocket_tombstones(websocket, (size_t)(client - websocket->clients));
 }
 
 static struct WebsocketClient* get_websocket_client(struct Websocket* websocket, int websocket_fd) {
     assert(websocket != NULL);
-    struct WebsocketClient* head = websocket->clients;
-    while (head != NULL) {
-        if (head->websocket_fd == websocket_fd) break;
-        head = head->next_client;
+    size_t slot = get_websocket_client_slot(websocket, websocket_fd);
+    for (size_t i = 0; i < websocket->max_clients; i++) {
+        struct WebsocketClient* client = &(websocket->clients[slot]);
+        if (client->websocket_fd == websocket_fd) return client;
+        if (client->websocket_fd == WEBSOCKET_SLOT_EMPTY) break;
+        slot = (slot+1) % websocket->max_clients;
     }
-    return head;
+    return NULL;
+}
+
+// the slot stays in the table until httpd deletes the session, after a close frame the fd is no longer a websocket
+static bool websocket_is_client_open(const struct WebsocketClient* client) {
+    const struct Websocket* websocket = client->websocket;
+    if (client->websocket_fd < 0) return false;
+    return httpd_ws_get_fd_info(websocket->server, client->websocket_fd) == HTTPD_WS_CLIENT_WEBSOCKET;
+}
+
+// runs when httpd deletes the session whether it closed with a close frame, an error or from the other end
+static void websocket_handle_session_free(void* ctx) {
+    struct WebsocketClient* client = (struct WebsocketClient*)ctx;
+    assert(client != NULL);
+    struct Websocket* websocket = client->websocket;
+    assert(websocket != NULL);
+    ESP_LOGI(TAG, "releasing websocket client with socket_id=%d", client->websocket_fd);
+    remove_websocket_client(websocket, client);
+    const size_t remaining_clients = websocket_count_total_clients(websocket);
+    ESP_LOGI(TAG, "%u remaining websocket clients after closing one", remaining_clients);
+}
+
+struct WebsocketClientHandle websocket_get_client_handle(const struct WebsocketClient* client) {
+    assert(client != NULL);
+    struct WebsocketClientHandle handle = {
+        .websocket_fd = client->websocket_fd,
+        .generation = client->generation,
+    };
+    return handle;
+}
+
+struct WebsocketClient* websocket_resolve_client_handle(struct Websocket* websocket, struct WebsocketClientHandle handle) {
+    assert(websocket != NULL);
+    if (handle.websocket_fd < 0) return NULL;
+    struct WebsocketClient* client = get_websocket_client(websocket, handle.websocket_fd);
+    if (client == NULL || client->generation != handle.generation) return NULL;
+    if (!websocket_is_client_open(client)) return NULL;
+    return client;
+}
+
+// an fd of -1 matches no client so NULL excludes nobody
+static struct WebsocketClientHandle websocket_get_exclude_handle(const struct WebsocketClient* exclude) {
+    if (exclude != NULL) return websocket_get_client_handle(exclude);
+    struct WebsocketClientHandle handle = {
+        .websocket_fd = -1,
+        .generation = 0,
+    };
+    return handle;
+}
+
+static bool websocket_is_client_handle(const struct WebsocketClient* client, struct WebsocketClientHandle handle) {
+    assert(client != NULL);
+    return client->websocket_fd == handle.websocket_fd && client->generation == handle.generation;
 }
 
 size_t websocket_count_total_clients(struct Websocket* websocket) {
     assert(websocket != NULL);
-    size_t total = 0;
-    struct WebsocketClient* head = websocket->clients;
-    while (head != NULL) {
-        total++;
-        head = head->next_client;
-    }
-    return total;
+    return websocket->total_clients;
 }
 
 static esp_err_t websocket_handle_open(httpd_req_t* request) {
@@ -71,6 +227,8 @@ static esp_err_t websocket_handle_open(httpd_req_t* request) {
     if (client == NULL) {
         return ESP_FAIL;
     }
+    // the session owns the slot so it is released however the connection ends
+    httpd_sess_set_ctx(request->handle, websocket_fd, (void*)client, websocket_handle_session_free);
     const size_t total_clients = websocket_count_total_clients(websocket);
     ESP_LOGI(TAG, "%u total websocket clients after adding one", total_clients);
     if (websocket->on_open != NULL) websocket->on_open(request, client);
@@ -84,16 +242,14 @@ static esp_err_t websocket_handle_close(httpd_req_t* request) {
 
     const int websocket_fd = httpd_req_to_sockfd(request);
     ESP_LOGI(TAG, "closing websocket connection with socket_id=%d", websocket_fd);
-    struct WebsocketClient* client = pop_websocket_client(websocket, websocket_fd);
+    struct WebsocketClient* client = get_websocket_client(websocket, websocket_fd);
     if (client == NULL) {
         ESP_LOGE(TAG, "tried to remove untracked websocket client with fd=%d", websocket_fd);
         return ESP_FAIL;
     }
 
+    // httpd closes the session after this frame which releases the slot
     if (websocket->on_close != NULL) websocket->on_close(request, client);
-    free(client);
-    const size_t remaining_clients = websocket_count_total_clients(websocket);
-    ESP_LOGI(TAG, "%u remaining websocket clients after closing one", remaining_clients);
     return ESP_OK;
 }
 
@@ -108,7 +264,10 @@ static esp_err_t websocket_handle_binary_data(httpd_req_t* request, uint8_t *dat
         ESP_LOGE(TAG, "failed to find websocket client with fd=%d", websocket_fd);
         return ESP_FAIL;
     }
+    // replies to a frame leave in one write however many messages the handler sends
+    websocket_cork(client);
     if (websocket->on_binary_frame != NULL) websocket->on_binary_frame(request, client, data, length);
+    websocket_uncork(client);
     return ESP_OK;
 }
 
@@ -123,61 +282,85 @@ static esp_err_t websocket_handle_ping(httpd_req_t* request) {
     return httpd_ws_send_frame(request, &pong_frame);
 }
 
+// frame payloads point into the httpd scratch buffer and are only valid during the call
+static esp_err_t websocket_handle_frame(httpd_req_t* request, httpd_ws_frame_t* frame, void* args) {
+    assert(request != NULL);
+    assert(frame != NULL);
+    struct Websocket* websocket = (struct Websocket*)args;
+    assert(websocket != NULL);
+    websocket->stats.rx_frames++;
+    websocket->stats.rx_bytes += frame->len;
+
+    switch (frame->type) {
+        case HTTPD_WS_TYPE_BINARY: return websocket_handle_binary_data(request, frame->payload, frame->len);
+        case HTTPD_WS_TYPE_CLOSE: return websocket_handle_close(request);
+        case HTTPD_WS_TYPE_PING: return websocket_handle_ping(request);
+        default: {
+            ESP_LOGW(TAG, "Unhandled websocket frame type: %u", frame->type);
+            return ESP_OK;
+        }
+    }
+}
+
 static esp_err_t websocket_uri_handler(httpd_req_t* request) {
     assert(request != NULL);
     struct Websocket* websocket = (struct Websocket*)request->user_ctx;
     assert(websocket != NULL);
     assert(websocket->server != NULL);
     assert(websocket->server == request->handle);
-    assert(websocket->receive_buffer != NULL);
-    assert(websocket->transmit_buffer != NULL);
-    assert(websocket->receive_buffer_size > 0);
+    assert(websocket->clients != NULL);
     assert(websocket->transmit_buffer_size > 0);
 
     if (request->method == HTTP_GET) {
         return websocket_handle_open(request);
     }
 
-    httpd_ws_frame_t frame;
-    frame.final = false;
-    frame.fragmented = false;
-    frame.type = HTTPD_WS_TYPE_BINARY;
-    frame.payload = websocket->receive_buffer;
-    frame.len = 0;
-
-    // get frame length by passing 0
-    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_ws_recv_frame(request, &frame, 0));
-    if (frame.len > websocket->receive_buffer_size) {
-        ESP_LOGE(TAG, "frame len is above maximum: %u > %u", frame.len, websocket->receive_buffer_size);
-        return ESP_FAIL;
-    }
-    // read full frame
-    if (frame.len > 0) {
-        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_ws_recv_frame(request, &frame, frame.len));
-    }
-
-    switch (frame.type) {
-        case HTTPD_WS_TYPE_BINARY: return websocket_handle_binary_data(request, frame.payload, frame.len);
-        case HTTPD_WS_TYPE_CLOSE: return websocket_handle_close(request);
-        case HTTPD_WS_TYPE_PING: return websocket_handle_ping(request);
-        default: {
-            ESP_LOGW(TAG, "Unhandled websocket frame type: %u", frame.type);
-            return ESP_OK;
-        }
-    }
+    // dispatches every frame that arrived in the same segment without copying the payloads
+    const esp_err_t status = httpd_ws_recv_frames(request, websocket_handle_frame, (void*)websocket);
+    ESP_ERROR_CHECK_WITHOUT_ABORT(status);
+    return status;
 }
 
-esp_err_t websocket_register(httpd_handle_t server, struct Websocket* websocket, size_t buffer_size) {
+esp_err_t websocket_register(httpd_handle_t server, struct Websocket* websocket, size_t buffer_size, size_t max_clients) {
     assert(server != NULL);
     assert(websocket != NULL);
     assert(websocket->uri != NULL);
+    // corked frames only use the 16bit length header
+    assert(buffer_size <= UINT16_MAX);
+    assert(max_clients > 0);
 
-    websocket->receive_buffer = malloc(buffer_size);
-    assert(websocket->receive_buffer != NULL);
-    websocket->receive_buffer_size = buffer_size;
-    websocket->transmit_buffer = malloc(buffer_size);
-    assert(websocket->transmit_buffer != NULL);
     websocket->transmit_buffer_size = buffer_size;
+    websocket->cork_buffer_size = WEBSOCKET_MAX_CORKED_FRAMES*(WEBSOCKET_MAX_FRAME_HEADER_SIZE+buffer_size);
+
+    // client slots and their transmit and cork buffers are allocated once up front
+    websocket->clients = malloc(max_clients*sizeof(struct WebsocketClient));
+    assert(websocket->clients != NULL);
+    const size_t client_buffer_size = websocket->transmit_buffer_size + websocket->cork_buffer_size;
+    websocket->client_buffers = malloc(max_clients*client_buffer_size);
+    assert(websocket->client_buffers != NULL);
+    websocket->max_clients = max_clients;
+    websocket->total_clients = 0;
+    websocket->next_generation = 1;
+    for (size_t i = 0; i < max_clients; i++) {
+        struct WebsocketClient* client = &(websocket->clients[i]);
+        client->websocket = websocket;
+        client->websocket_fd = WEBSOCKET_SLOT_EMPTY;
+        client->generation = 0;
+        uint8_t* client_buffer = &(websocket->client_buffers[i*client_buffer_size]);
+        client->transmit_buffer = client_buffer;
+        client->cork_buffer = &client_buffer[websocket->transmit_buffer_size];
+        client->cork_length = 0;
+        client->cork_depth = 0;
+        client->subscriptions = 0;
+    }
+    memset(websocket->topic_subscribers, 0, sizeof(websocket->topic_subscribers));
+    memset(websocket->topic_mailbox, 0, sizeof(websocket->topic_mailbox));
+    websocket_entry_pool_init(&websocket->task_pool, sizeof(struct WebsocketAsyncTaskEntry), WEBSOCKET_MAX_QUEUED_TASKS);
+    websocket_entry_pool_init(
+        &websocket->broadcast_pool,
+        sizeof(struct WebsocketBroadcastEntry) + WEBSOCKET_MAX_FRAME_HEADER_SIZE + buffer_size,
+        WEBSOCKET_MAX_QUEUED_BROADCASTS
+    );
     websocket->server = server;
 
     httpd_uri_t websocket_uri = {
@@ -192,58 +375,152 @@ esp_err_t websocket_register(httpd_handle_t server, struct Websocket* websocket,
     return httpd_register_uri_handler(server, &websocket_uri);
 }
 
+static esp_err_t websocket_flush_cork_buffer(struct WebsocketClient* client) {
+    assert(client != NULL);
+    struct Websocket* websocket = client->websocket;
+    assert(websocket != NULL);
+    if (client->cork_length == 0) return ESP_OK;
+
+    const size_t length = client->cork_length;
+    client->cork_length = 0;
+    // a short write would cut a frame in half so keep going until the whole buffer is out
+    const char* data = (const char*)client->cork_buffer;
+    size_t total_sent = 0;
+    while (total_sent < length) {
+        const int sent = httpd_socket_send(websocket->server, client->websocket_fd, &data[total_sent], length-total_sent, 0);
+        if (sent < 0) {
+            ESP_LOGE(TAG, "failed to flush %u of %u corked bytes to websocket_fd=%d", length-total_sent, length, client->websocket_fd);
+            return ESP_FAIL;
+        }
+        total_sent += sent;
+    }
+    return ESP_OK;
+}
+
+static size_t websocket_get_frame_header_size(size_t size) {
+    return (size <= 125) ? 2 : 4;
+}
+
+// unmasked final binary frame header, returns header size
+static size_t websocket_write_frame_header(uint8_t* header, size_t size) {
+    assert(size <= UINT16_MAX);
+    header[0] = 0x80 | HTTPD_WS_TYPE_BINARY; // FIN bit
+    if (size <= 125) {
+        header[1] = (uint8_t)size;
+        return 2;
+    }
+    header[1] = 126;
+    header[2] = (uint8_t)(size >> 8);
+    header[3] = (uint8_t)(size);
+    return 4;
+}
+
+// packs the pending transmit buffer as an unmasked binary frame into the cork buffer
+static esp_err_t websocket_cork_pending_binary_data(struct WebsocketClient* client, size_t size) {
+    assert(client != NULL);
+    struct Websocket* websocket = client->websocket;
+    assert(websocket != NULL);
+    assert(client->cork_depth > 0);
+
+    const size_t header_size = websocket_get_frame_header_size(size);
+    if (client->cork_length + header_size + size > websocket->cork_buffer_size) {
+        const esp_err_t status = websocket_flush_cork_buffer(client);
+        if (status != ESP_OK) return status;
+    }
+
+    uint8_t* header = &client->cork_buffer[client->cork_length];
+    websocket_write_frame_header(header, size);
+    memcpy(&header[header_size], client->transmit_buffer, size);
+    client->cork_length += header_size + size;
+    websocket->stats.tx_frames++;
+    websocket->stats.tx_bytes += size;
+    return ESP_OK;
+}
+
+void websocket_cork(struct WebsocketClient* client) {
+    assert(client != NULL);
+    client->cork_depth++;
+}
+
+esp_err_t websocket_uncork(struct WebsocketClient* client) {
+    assert(client != NULL);
+    assert(client->cork_depth > 0);
+    client->cork_depth--;
+    if (client->cork_depth > 0) return ESP_OK;
+    return websocket_flush_cork_buffer(client);
+}
+
 esp_err_t websocket_send_pending_binary_data_sync(struct WebsocketClient* client, httpd_req_t* request, size_t size) {
     assert(client != NULL);
     struct Websocket* websocket = client->websocket;
     assert(websocket != NULL);
-    assert(websocket->transmit_buffer != NULL);
+    assert(client->transmit_buffer != NULL);
     assert(websocket->transmit_buffer_size >= size);
+    if (client->cork_depth > 0) {
+        return websocket_cork_pending_binary_data(client, size);
+    }
     httpd_ws_frame_t frame = {
         .fragmented = false,
         .final = true,
         .type = HTTPD_WS_TYPE_BINARY,
-        .payload = websocket->transmit_buffer,
+        .payload = client->transmit_buffer,
         .len = size,
     };
-    return httpd_ws_send_frame(request, &frame);
+    const esp_err_t status = httpd_ws_send_frame(request, &frame);
+    if (status == ESP_OK) {
+        websocket->stats.tx_frames++;
+        websocket->stats.tx_bytes += size;
+    }
+    return status;
 }
 
 esp_err_t websocket_send_pending_binary_data_async(struct WebsocketClient* client, size_t size) {
     assert(client != NULL);
     struct Websocket* websocket = client->websocket;
     assert(websocket != NULL);
-    assert(websocket->transmit_buffer != NULL);
+    assert(client->transmit_buffer != NULL);
     assert(websocket->transmit_buffer_size >= size);
     httpd_handle_t server = websocket->server;
     assert(server != NULL);
+    if (client->cork_depth > 0) {
+        return websocket_cork_pending_binary_data(client, size);
+    }
     httpd_ws_frame_t frame = {
         .fragmented = false,
         .final = true,
         .type = HTTPD_WS_TYPE_BINARY,
-        .payload = websocket->transmit_buffer,
+        .payload = client->transmit_buffer,
         .len = size,
     };
-    return httpd_ws_send_frame_async(server, client->websocket_fd, &frame);
+    const esp_err_t status = httpd_ws_send_frame_async(server, client->websocket_fd, &frame);
+    if (status == ESP_OK) {
+        websocket->stats.tx_frames++;
+        websocket->stats.tx_bytes += size;
+    }
+    return status;
 }
 
-struct WebsocketAsyncTaskEntry {
-    struct WebsocketClient* client;
-    websocket_async_task_t task;
-    void* args;
-};
-
 static void websocket_run_enqueued_async_task(void* _entry) {
     struct WebsocketAsyncTaskEntry* entry = (struct WebsocketAsyncTaskEntry*)_entry;
     assert(entry != NULL);
 
-    struct WebsocketClient* client = entry->client;
+    struct Websocket* websocket = entry->websocket;
+    assert(websocket != NULL);
+    const struct WebsocketClientHandle handle = entry->client;
     websocket_async_task_t task = entry->task;
     void* args = entry->args;
-    free(entry);
+    websocket_entry_pool_give(&websocket->task_pool, entry);
 
-    assert(client != NULL);
     assert(task != NULL);
+    struct WebsocketClient* client = websocket_resolve_client_handle(websocket, handle);
+    if (client == NULL) {
+        ESP_LOGD(TAG, "skipping async task for closed websocket client fd=%d", handle.websocket_fd);
+        websocket->stats.stale_tasks++;
+        return;
+    }
+    websocket_cork(client);
     task(client, args);
+    websocket_uncork(client);
 }
 
 esp_err_t websocket_queue_async_task(struct WebsocketClient* client, websocket_async_task_t task, void* args) {
@@ -255,14 +532,205 @@ esp_err_t websocket_queue_async_task(struct WebsocketClient* client, websocket_a
     httpd_handle_t server = websocket->server;
     assert(server != NULL);
 
-    struct WebsocketAsyncTaskEntry* entry = malloc(sizeof(struct WebsocketAsyncTaskEntry));
-    assert(entry != NULL);
-    entry->client = client;
+    struct WebsocketAsyncTaskEntry* entry = websocket_entry_pool_take(&websocket->task_pool);
+    if (entry == NULL) {
+        websocket_count_queue_drop(websocket);
+        return ESP_ERR_NO_MEM;
+    }
+    entry->websocket = websocket;
+    entry->client = websocket_get_client_handle(client);
     entry->task = task;
     entry->args = args;
     const esp_err_t status = httpd_queue_work(server, websocket_run_enqueued_async_task, entry);
     if (status != ESP_OK) {
-        free(entry);
+        websocket_entry_pool_give(&websocket->task_pool, entry);
+        websocket_count_queue_drop(websocket);
+    }
+    return status;
+}
+
+
+static void websocket_send_broadcast_frame(struct WebsocketClient* client, const struct WebsocketBroadcastEntry* entry) {
+    struct Websocket* websocket = client->websocket;
+    if (client->cork_depth > 0) {
+        if (client->cork_length + entry->frame_size > websocket->cork_buffer_size) {
+            websocket->stats.tx_drops++;
+            return;
+        }
+        memcpy(&client->cork_buffer[client->cork_length], entry->frame, entry->frame_size);
+        client->cork_length += entry->frame_size;
+        websocket->stats.tx_frames++;
+        websocket->stats.tx_bytes += entry->payload_size;
+        return;
+    }
+
+    const char* frame = (const char*)entry->frame;
+    int sent = httpd_socket_send(websocket->server, client->websocket_fd, frame, entry->frame_size, MSG_DONTWAIT);
+    if (sent == HTTPD_SOCK_ERR_TIMEOUT) {
+        // socket buffer is full, a slow client shouldn't stall the others
+        websocket->stats.tx_drops++;
+        return;
+    }
+    // a partially written frame has to be completed to keep the stream valid
+    size_t total_sent = (sent > 0) ? (size_t)sent : 0;
+    while (sent >= 0 && total_sent < entry->frame_size) {
+        sent = httpd_socket_send(websocket->server, client->websocket_fd, &frame[total_sent], entry->frame_size-total_sent, 0);
+        if (sent > 0) total_sent += sent;
+    }
+    if (sent < 0) {
+        ESP_LOGE(TAG, "failed to broadcast frame to websocket_fd=%d, error=%d", client->websocket_fd, sent);
+        return;
+    }
+    websocket->stats.tx_frames++;
+    websocket->stats.tx_bytes += entry->payload_size;
+}
+
+static void websocket_run_broadcast(void* _entry) {
+    struct WebsocketBroadcastEntry* entry = (struct WebsocketBroadcastEntry*)_entry;
+    assert(entry != NULL);
+    struct Websocket* websocket = entry->websocket;
+    assert(websocket != NULL);
+
+    // once out of the mailbox publishers leave the entry alone
+    if (entry->mailbox_topic >= 0) {
+        taskENTER_CRITICAL();
+        if (websocket->topic_mailbox[entry->mailbox_topic] == entry) {
+            websocket->topic_mailbox[entry->mailbox_topic] = NULL;
+        }
+        taskEXIT_CRITICAL();
+    }
+
+    for (size_t i = 0; i < websocket->max_clients; i++) {
+        struct WebsocketClient* client = &(websocket->clients[i]);
+        if (!websocket_is_client_open(client)) continue;
+        if (websocket_is_client_handle(client, entry->exclude)) continue;
+        if (entry->topic_mask != 0 && (client->subscriptions & entry->topic_mask) == 0) continue;
+        if (entry->filter != NULL && !entry->filter(client, entry->filter_args)) continue;
+        websocket_send_broadcast_frame(client, entry);
+    }
+    websocket_entry_pool_give(&websocket->broadcast_pool, entry);
+}
+
+static void websocket_write_broadcast_frame(struct WebsocketBroadcastEntry* entry, const uint8_t* data, size_t size) {
+    assert(data != NULL || size == 0);
+    const size_t header_size = websocket_write_frame_header(entry->frame, size);
+    if (size > 0) memcpy(&entry->frame[header_size], data, size);
+    entry->payload_size = size;
+    entry->frame_size = header_size + size;
+}
+
+esp_err_t websocket_broadcast(struct Websocket* websocket, const uint8_t* data, size_t size, websocket_client_filter_t filter, void* filter_args) {
+    assert(websocket != NULL);
+    assert(websocket->transmit_buffer_size >= size);
+    httpd_handle_t server = websocket->server;
+    assert(server != NULL);
+
+    struct WebsocketBroadcastEntry* entry = websocket_entry_pool_take(&websocket->broadcast_pool);
+    if (entry == NULL) {
+        websocket_count_queue_drop(websocket);
+        return ESP_ERR_NO_MEM;
+    }
+    entry->websocket = websocket;
+    entry->filter = filter;
+    entry->filter_args = filter_args;
+    entry->topic_mask = 0;
+    entry->mailbox_topic = -1;
+    entry->exclude = websocket_get_exclude_handle(NULL);
+    websocket_write_broadcast_frame(entry, data, size);
+
+    const esp_err_t status = httpd_queue_work(server, websocket_run_broadcast, entry);
+    if (status != ESP_OK) {
+        websocket_entry_pool_give(&websocket->broadcast_pool, entry);
+        websocket_count_queue_drop(websocket);
+    }
+    return status;
+}
+
+esp_err_t websocket_subscribe(struct WebsocketClient* client, uint8_t topic) {
+    assert(client != NULL);
+    struct Websocket* websocket = client->websocket;
+    assert(websocket != NULL);
+    if (topic >= WEBSOCKET_MAX_TOPICS) return ESP_ERR_INVALID_ARG;
+    if (websocket_is_subscribed(client, topic)) return ESP_OK;
+    client->subscriptions |= (1u << topic);
+    websocket->topic_subscribers[topic]++;
+    return ESP_OK;
+}
+
+esp_err_t websocket_unsubscribe(struct WebsocketClient* client, uint8_t topic) {
+    assert(client != NULL);
+    struct Websocket* websocket = client->websocket;
+    assert(websocket != NULL);
+    if (topic >= WEBSOCKET_MAX_TOPICS) return ESP_ERR_INVALID_ARG;
+    if (!websocket_is_subscribed(client, topic)) return ESP_OK;
+    client->subscriptions &= ~(1u << topic);
+    assert(websocket->topic_subscribers[topic] > 0);
+    websocket->topic_subscribers[topic]--;
+    return ESP_OK;
+}
+
+bool websocket_is_subscribed(const struct WebsocketClient* client, uint8_t topic) {
+    assert(client != NULL);
+    if (topic >= WEBSOCKET_MAX_TOPICS) return false;
+    return (client->subscriptions & (1u << topic)) != 0;
+}
+
+size_t websocket_count_topic_subscribers(const struct Websocket* websocket, uint8_t topic) {
+    assert(websocket != NULL);
+    if (topic >= WEBSOCKET_MAX_TOPICS) return 0;
+    return websocket->topic_subscribers[topic];
+}
+
+esp_err_t websocket_publish(struct Websocket* websocket, uint8_t topic, const uint8_t* data, size_t size, const struct WebsocketClient* exclude) {
+    assert(websocket != NULL);
+    if (topic >= WEBSOCKET_MAX_TOPICS) return ESP_ERR_INVALID_ARG;
+    // counts are only read here so a stale value at worst sends one frame late or not at all
+    const size_t total_subscribers = websocket->topic_subscribers[topic];
+    if (total_subscribers == 0) return ESP_OK;
+    if (total_subscribers == 1 && exclude != NULL && websocket_is_subscribed(exclude, topic)) return ESP_OK;
+    assert(websocket->transmit_buffer_size >= size);
+    httpd_handle_t server = websocket->server;
+    assert(server != NULL);
+    const struct WebsocketClientHandle exclude_handle = websocket_get_exclude_handle(exclude);
+
+    // latest value wins, publishing while the topic's last value is still queued replaces it
+    bool is_coalesced = false;
+    taskENTER_CRITICAL();
+    struct WebsocketBroadcastEntry* pending_entry = websocket->topic_mailbox[topic];
+    if (pending_entry != NULL) {
+        websocket_write_broadcast_frame(pending_entry, data, size);
+        pending_entry->exclude = exclude_handle;
+        websocket->stats.coalesced++;
+        is_coalesced = true;
+    }
+    taskEXIT_CRITICAL();
+    if (is_coalesced) return ESP_OK;
+
+    struct WebsocketBroadcastEntry* entry = websocket_entry_pool_take(&websocket->broadcast_pool);
+    if (entry == NULL) {
+        websocket_count_queue_drop(websocket);
+        return ESP_ERR_NO_MEM;
+    }
+    entry->websocket = websocket;
+    entry->filter = NULL;
+    entry->filter_args = NULL;
+    entry->topic_mask = (uint8_t)(1u << topic);
+    entry->mailbox_topic = (int8_t)topic;
+    entry->exclude = exclude_handle;
+    websocket_write_broadcast_frame(entry, data, size);
+
+    taskENTER_CRITICAL();
+    websocket->topic_mailbox[topic] = entry;
+    taskEXIT_CRITICAL();
+    const esp_err_t status = httpd_queue_work(server, websocket_run_broadcast, entry);
+    if (status != ESP_OK) {
+        taskENTER_CRITICAL();
+        if (websocket->topic_mailbox[topic] == entry) {
+            websocket->topic_mailbox[topic] = NULL;
+        }
+        taskEXIT_CRITICAL();
+        websocket_entry_pool_give(&websocket->broadcast_pool, entry);
+        websocket_count_queue_drop(websocket);
     }
     return status;
 }
@@ -14,7 +14,6 @@
 #include <esp_err.h>
 #include <esp_log.h>
 #include <esp_spi_flash.h>
-#include <esp_spiffs.h>
 #include <esp_system.h>
 
 #include "dht11.h"
@@ -41,14 +40,21 @@ struct PC_IO_Config g_pc_io_config = { // extern
 };
 struct Websocket g_websocket = { // extern
     // buffers
-    .receive_buffer_size = 0,
     .transmit_buffer_size = 0,
-    .receive_buffer = NULL,
-    .transmit_buffer = NULL,
+    .cork_buffer_size = 0,
     // handles
     .uri = "/api/v1/websocket",
     .server = NULL,
     .clients = NULL,
+    .max_clients = 0,
+    .total_clients = 0,
+    .next_generation = 0,
+    .client_buffers = NULL,
+    .topic_subscribers = { 0 },
+    .topic_mailbox = { NULL },
+    .task_pool = { 0 },
+    .broadcast_pool = { 0 },
+    .stats = { 0 },
     // callbacks
     .on_binary_frame = NULL,
     .on_open = NULL,
@@ -101,6 +107,14 @@ esp_err_t init_server(void) {
     const uint16_t port = 80;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = port;
+    // reuse connections for page loads and reclaim the ones browsers leave idle
+    config.lru_purge_enable = true;
+    config.http_keep_alive_timeout = 5;
+    config.http_keep_alive_max_requests = 32;
+    // answer with 503 rather than stall new clients when every socket is busy
+    config.shed_when_full = true;
+    // static files are served by one "/*" handler
+    config.uri_match_fn = httpd_uri_match_wildcard;
 
     const esp_err_t start_status = httpd_start(&http_server, &config);
     if (start_status == ESP_OK) {
@@ -110,15 +124,8 @@ esp_err_t init_server(void) {
         return ESP_FAIL;
     }
     
-    const esp_err_t register_status = webserver_register_endpoints(http_server);
-    if (register_status == ESP_OK) {
-        ESP_LOGI(INIT_TAG, "registered webserver endpoints on port=%d", port);
-    } else {
-        ESP_LOGE(INIT_TAG, "failed to register endpoints on port=%d (%s)", port, esp_err_to_name(register_status));
-        return ESP_FAIL;
-    }
-
-    const esp_err_t websocket_register_status = websocket_register(http_server, &g_websocket, 64);
+    // the stats reply is the largest frame sent to a single client
+    const esp_err_t websocket_register_status = websocket_register(http_server, &g_websocket, 96, config.max_open_sockets);
     if (websocket_register_status == ESP_OK) {
         ESP_LOGI(INIT_TAG, "registered websocket handler on port=%d", port);
         websocket_attach_handlers(&g_websocket);
@@ -127,6 +134,15 @@ esp_err_t init_server(void) {
         return ESP_FAIL;
     }
 
+    // matches every uri so it's registered after the websocket
+    const esp_err_t register_status = webserver_register_endpoints(http_server);
+    if (register_status == ESP_OK) {
+        ESP_LOGI(INIT_TAG, "registered webserver endpoints on port=%d", port);
+    } else {
+        ESP_LOGE(INIT_TAG, "failed to register endpoints on port=%d (%s)", port, esp_err_to_name(register_status));
+        return ESP_FAIL;
+    }
+
     return ESP_OK;
 }
 
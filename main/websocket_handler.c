@@ -4,10 +4,17 @@
 #include "shifted_pwm.h"
 #include "pc_io.h"
 #include "dht11.h"
+#include "webserver.h"
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/timers.h>
 #include <esp_log.h>
+#include <esp_system.h>
+#include <string.h>
 
 static const char TAG[] = "websocket-handler";
+static const uint8_t SUBSCRIBE_CMD = 0x05;
+static const uint8_t STATS_CMD = 0x04;
 static const uint8_t DHT11_CMD = 0x03;
 static const uint8_t PC_IO_CMD = 0x02;
 static const uint8_t LED_CMD = 0x01;
@@ -17,15 +24,24 @@ static const uint8_t PC_IO_RESET = 0x03;
 static const uint8_t PC_IO_STATUS = 0x04;
 static const uint8_t LED_SET = 0x01;
 static const uint8_t LED_GET = 0x02;
+static const uint8_t SUBSCRIBE_ADD = 0x01;
+static const uint8_t SUBSCRIBE_REMOVE = 0x02;
+// topic ids shared with static/js/common.js
+static const uint8_t TOPIC_PC_STATUS = 0;
+static const uint8_t TOPIC_DHT11 = 1;
+static const uint8_t TOPIC_LED_STATE = 2;
+static const uint8_t TOPIC_STATS = 3;
+static const uint32_t STATS_PUBLISH_PERIOD_MS = 1000;
 
-static struct WebsocketClient* dht11_websocket_client = NULL;
+static TimerHandle_t stats_publish_timer = NULL;
 
+// the requester always gets the reading, other clients only when subscribed to dht11
 void websocket_async_send_dht11(struct WebsocketClient* client, void *args) {
     static const char SUBTAG[] = "dht11-async-websocket-handler";
     assert(client != NULL);
-    const struct Websocket* websocket = client->websocket;
+    struct Websocket* websocket = client->websocket;
     assert(websocket != NULL);
-    uint8_t* buffer = websocket->transmit_buffer;
+    uint8_t* buffer = client->transmit_buffer;
     assert(buffer != NULL);
 
     size_t length = 0;
@@ -46,17 +62,19 @@ void websocket_async_send_dht11(struct WebsocketClient* client, void *args) {
             client->websocket_fd, measurement.humidity, measurement.temperature, esp_err_to_name(status)
         );
     }
+    const esp_err_t publish_status = websocket_publish(websocket, TOPIC_DHT11, buffer, length, client);
+    if (publish_status != ESP_OK) {
+        ESP_LOGE(SUBTAG, "Failed to publish dht11 data, error='%s'", esp_err_to_name(publish_status));
+    }
 }
 
 static void websocket_on_dht11_frame(httpd_req_t* request, struct WebsocketClient* client, const uint8_t* data, size_t size) {
     static const char SUBTAG[] = "dht11-websocket-handler";
     assert(request != NULL);
     assert(client != NULL);
-    dht11_websocket_client = client;
     const esp_err_t status = websocket_queue_async_task(client, websocket_async_send_dht11, NULL);
     if (status != ESP_OK) {
         ESP_LOGE(SUBTAG, "failed to queue async dht11 task: '%s'", esp_err_to_name(status));
-        dht11_websocket_client = NULL;
     }
 }
 
@@ -64,7 +82,7 @@ static void websocket_on_pc_io_frame(httpd_req_t* request, struct WebsocketClien
     static const char SUBTAG[] = "pc-io-websocket-handler";
     const struct Websocket* websocket = client->websocket;
     assert(websocket != NULL);
-    uint8_t* buffer = websocket->transmit_buffer;
+    uint8_t* buffer = client->transmit_buffer;
     assert(buffer != NULL);
 
     if (size == 0) {
@@ -96,11 +114,22 @@ static void websocket_on_pc_io_frame(httpd_req_t* request, struct WebsocketClien
     }
 }
 
+// writes [LED_CMD, LED_GET, total_pins, values...] and returns the length
+static size_t write_led_state(uint8_t* buffer) {
+    buffer[0] = LED_CMD;
+    buffer[1] = LED_GET;
+    buffer[2] = SHIFTED_PWM_TOTAL_PINS;
+    for (int i = 0; i < SHIFTED_PWM_TOTAL_PINS; i++) {
+        buffer[3+i] = shifted_pwm_get_value(i);
+    }
+    return 3+SHIFTED_PWM_TOTAL_PINS;
+}
+
 static void websocket_on_shifted_pwm_frame(httpd_req_t* request, struct WebsocketClient* client, const uint8_t* data, size_t size) {
     static const char SUBTAG[] = "shifted-pwm-websocket-handler";
-    const struct Websocket* websocket = client->websocket;
+    struct Websocket* websocket = client->websocket;
     assert(websocket != NULL);
-    uint8_t* buffer = websocket->transmit_buffer;
+    uint8_t* buffer = client->transmit_buffer;
     assert(buffer != NULL);
 
     if (size == 0) {
@@ -110,13 +139,8 @@ static void websocket_on_shifted_pwm_frame(httpd_req_t* request, struct Websocke
 
     const uint8_t mode = data[0];
     if (mode == LED_GET) {
-        buffer[0] = LED_CMD;
-        buffer[1] = LED_GET;
-        buffer[2] = SHIFTED_PWM_TOTAL_PINS;
-        for (int i = 0; i < SHIFTED_PWM_TOTAL_PINS; i++) {
-            buffer[3+i] = shifted_pwm_get_value(i);
-        }
-        const esp_err_t status = websocket_send_pending_binary_data_sync(client, request, 3+SHIFTED_PWM_TOTAL_PINS);
+        const size_t length = write_led_state(buffer);
+        const esp_err_t status = websocket_send_pending_binary_data_sync(client, request, length);
         if (status != ESP_OK) {
             ESP_LOGE(SUBTAG, "failed to send shifted pwm values: err='%s'", esp_err_to_name(status));
         }
@@ -128,51 +152,141 @@ static void websocket_on_shifted_pwm_frame(httpd_req_t* request, struct Websocke
                 shifted_pwm_set_value(pin, value);
             }
         }
-        // disable reply since it slows things down
-        // reply_buffer[0] = LED_CMD;
-        // reply_buffer[1] = LED_SET;
-        // write_websocket_data(request, reply_buffer, 2);
+        // no reply to the sender since it slows slider drags down, other dashboards follow through led.state
+        if (websocket_count_topic_subscribers(websocket, TOPIC_LED_STATE) > 0) {
+            const size_t length = write_led_state(buffer);
+            const esp_err_t status = websocket_publish(websocket, TOPIC_LED_STATE, buffer, length, client);
+            if (status != ESP_OK) {
+                ESP_LOGE(SUBTAG, "failed to publish shifted pwm values: err='%s'", esp_err_to_name(status));
+            }
+        }
     } else {
         ESP_LOGW(SUBTAG, "got unhandled shifted pwm command header=%u", mode);
     }
 }
 
-void websocket_async_send_pc_io_status(struct WebsocketClient* client, void *args) {
-    static const char SUBTAG[] = "pc-io-status-async-websocket-handler";
-    assert(client != NULL);
+// registered once, the status is encoded once and fanned out to pc.status subscribers
+static void pc_io_status_listener(bool is_powered, void* _websocket) {
+    static const char SUBTAG[] = "pc-io-status-interrupt-listener-websocket-handler";
+    struct Websocket *websocket = (struct Websocket*)_websocket;
+    assert(websocket != NULL);
+    const uint8_t data[3] = { PC_IO_CMD, PC_IO_STATUS, is_powered ? 0x01 : 0x00 };
+    const esp_err_t status = websocket_publish(websocket, TOPIC_PC_STATUS, data, sizeof(data), NULL);
+    if (status != ESP_OK) {
+        ESP_LOGE(SUBTAG, "failed to publish pc io status: is_powered=%u, error='%s'", is_powered, esp_err_to_name(status));
+    }
+}
+
+static size_t write_stats_u32(uint8_t* buffer, size_t offset, uint32_t value) {
+    buffer[offset+0] = (uint8_t)(value);
+    buffer[offset+1] = (uint8_t)(value >> 8);
+    buffer[offset+2] = (uint8_t)(value >> 16);
+    buffer[offset+3] = (uint8_t)(value >> 24);
+    return offset+4;
+}
+
+// writes [STATS_CMD, count, count*u32 little endian] and returns the length, new counters are only ever appended
+static size_t write_stats(const struct Websocket* websocket, uint8_t* buffer, size_t buffer_size) {
+    httpd_stats_t server_stats;
+    memset(&server_stats, 0, sizeof(server_stats));
+    httpd_get_stats(websocket->server, &server_stats);
+    struct WebserverStats webserver_stats;
+    webserver_get_stats(&webserver_stats);
+    const uint32_t values[] = {
+        esp_get_free_heap_size(),
+        esp_get_minimum_free_heap_size(),
+        websocket->stats.rx_frames,
+        websocket->stats.rx_bytes,
+        websocket->stats.tx_frames,
+        websocket->stats.tx_bytes,
+        websocket->task_pool.max_taken,
+        server_stats.accepted_conns,
+        server_stats.shed_conns,
+        server_stats.lru_purged_conns,
+        server_stats.idle_closed_conns,
+        websocket->stats.tx_drops,
+        websocket->stats.queue_drops,
+        websocket->stats.stale_tasks,
+        websocket->stats.coalesced,
+        webserver_stats.verified_assets,
+        webserver_stats.unhealthy_assets,
+        webserver_stats.hash_bytes_per_ms,
+        websocket->broadcast_pool.max_taken,
+        webserver_stats.cache_hits,
+        webserver_stats.cache_misses,
+        webserver_stats.cache_evictions,
+    };
+    const size_t total_values = sizeof(values)/sizeof(values[0]);
+    assert(buffer_size >= 2+total_values*4);
+
+    buffer[0] = STATS_CMD;
+    buffer[1] = (uint8_t)total_values;
+    size_t length = 2;
+    for (size_t i = 0; i < total_values; i++) {
+        length = write_stats_u32(buffer, length, values[i]);
+    }
+    return length;
+}
+
+static void websocket_on_stats_frame(httpd_req_t* request, struct WebsocketClient* client, const uint8_t* data, size_t size) {
+    static const char SUBTAG[] = "stats-websocket-handler";
     const struct Websocket* websocket = client->websocket;
     assert(websocket != NULL);
-    uint8_t* buffer = websocket->transmit_buffer;
+    uint8_t* buffer = client->transmit_buffer;
     assert(buffer != NULL);
 
-    const bool is_powered = (bool)args;
-    buffer[0] = PC_IO_CMD;
-    buffer[1] = PC_IO_STATUS;
-    buffer[2] = is_powered ? 0x01 : 0x00;
-    const esp_err_t status = websocket_send_pending_binary_data_async(client, 3);
+    const size_t length = write_stats(websocket, buffer, websocket->transmit_buffer_size);
+    const esp_err_t status = websocket_send_pending_binary_data_sync(client, request, length);
     if (status != ESP_OK) {
-        ESP_LOGE(SUBTAG, "Failed to send pc io status websocket_fd=%d, is_powered=%u, error='%s'",
-            client->websocket_fd, is_powered, esp_err_to_name(status)
-        );
-    } else {
-        ESP_LOGI(SUBTAG, "Sent pc io status to websocket_fd=%d, is_powered=%u", client->websocket_fd, is_powered);
+        ESP_LOGE(SUBTAG, "failed to send stats: err='%s'", esp_err_to_name(status));
     }
 }
 
-static void pc_io_status_listener(bool is_powered, void* _client) {
-    static const char SUBTAG[] = "pc-io-status-interrupt-listener-websocket-handler";
-    struct WebsocketClient *client = (struct WebsocketClient*)_client;
-    assert(client != NULL);
-    const esp_err_t status = websocket_queue_async_task(client, websocket_async_send_pc_io_status, (void*)is_powered);
+// runs on the timer task, stats are only gathered while someone is subscribed
+static void stats_publish_timer_callback(TimerHandle_t timer) {
+    static const char SUBTAG[] = "stats-publish-websocket-handler";
+    struct Websocket* websocket = (struct Websocket*)pvTimerGetTimerID(timer);
+    assert(websocket != NULL);
+    if (websocket_count_topic_subscribers(websocket, TOPIC_STATS) == 0) return;
+
+    uint8_t buffer[96];
+    const size_t length = write_stats(websocket, buffer, sizeof(buffer));
+    const esp_err_t status = websocket_publish(websocket, TOPIC_STATS, buffer, length, NULL);
     if (status != ESP_OK) {
-        ESP_LOGE(SUBTAG, "failed to queue async pc io status: websocket_fd=%d, is_powered=%u, error='%s'",
-            client->websocket_fd, is_powered, esp_err_to_name(status)
-        );
+        ESP_LOGE(SUBTAG, "failed to publish stats: err='%s'", esp_err_to_name(status));
     }
 }
 
-static void websocket_on_open(httpd_req_t* request, struct WebsocketClient* client) {
-    pc_io_status_listen(&g_pc_io_config, pc_io_status_listener, (void*)client);
+// [op, topic] replies with [SUBSCRIBE_CMD, op, topic, is_success]
+static void websocket_on_subscribe_frame(httpd_req_t* request, struct WebsocketClient* client, const uint8_t* data, size_t size) {
+    static const char SUBTAG[] = "subscribe-websocket-handler";
+    uint8_t* buffer = client->transmit_buffer;
+    assert(buffer != NULL);
+
+    if (size < 2) {
+        ESP_LOGE(SUBTAG, "Got an unexpected subscribe command length=%u", size);
+        return;
+    }
+
+    const uint8_t op = data[0];
+    const uint8_t topic = data[1];
+    esp_err_t resp_status = ESP_FAIL;
+    if (op == SUBSCRIBE_ADD) {
+        resp_status = websocket_subscribe(client, topic);
+    } else if (op == SUBSCRIBE_REMOVE) {
+        resp_status = websocket_unsubscribe(client, topic);
+    } else {
+        ESP_LOGE(SUBTAG, "Unknown subscribe op: 0x%02x", op);
+    }
+
+    buffer[0] = SUBSCRIBE_CMD;
+    buffer[1] = op;
+    buffer[2] = topic;
+    buffer[3] = (resp_status == ESP_OK) ? 0x01 : 0x00;
+    const esp_err_t status = websocket_send_pending_binary_data_sync(client, request, 4);
+    if (status != ESP_OK) {
+        ESP_LOGE(SUBTAG, "failed to send subscribe response op=%u, topic=%u, err='%s'", op, topic, esp_err_to_name(status));
+    }
 }
 
 static void websocket_on_binary_frame(httpd_req_t* request, struct WebsocketClient* client, const uint8_t* data, size_t size) {
@@ -193,18 +307,19 @@ static void websocket_on_binary_frame(httpd_req_t* request, struct WebsocketClie
     case LED_CMD:   websocket_on_shifted_pwm_frame(request, client, cmd_data, cmd_length); break;
     case PC_IO_CMD: websocket_on_pc_io_frame(request, client, cmd_data, cmd_length); break;
     case DHT11_CMD: websocket_on_dht11_frame(request, client, cmd_data, cmd_length); break;
+    case STATS_CMD: websocket_on_stats_frame(request, client, cmd_data, cmd_length); break;
+    case SUBSCRIBE_CMD: websocket_on_subscribe_frame(request, client, cmd_data, cmd_length); break;
     default:        ESP_LOGD(TAG, "Unknown cmd: 0x%02x", cmd_code); break;
     }
 }
 
-// client will be freed after this call
-static void websocket_on_close(httpd_req_t* request, struct WebsocketClient* client) {
-    pc_io_status_unlisten(&g_pc_io_config, pc_io_status_listener, (void*)client);
-}
-
 void websocket_attach_handlers(struct Websocket* websocket) {
     assert(websocket != NULL);
-    websocket->on_open = websocket_on_open;
+    websocket->on_open = NULL;
     websocket->on_binary_frame = websocket_on_binary_frame;
-    websocket->on_close = websocket_on_close;
+    websocket->on_close = NULL;
+    pc_io_status_listen(&g_pc_io_config, pc_io_status_listener, (void*)websocket);
+    stats_publish_timer = xTimerCreate("ws-stats-timer", STATS_PUBLISH_PERIOD_MS / portTICK_RATE_MS, pdTRUE, (void*)websocket, stats_publish_timer_callback);
+    assert(stats_publish_timer != NULL);
+    xTimerStart(stats_publish_timer, 0);
 }
\ No newline at end of file
@@ -0,0 +1,151 @@
+import argparse
+import socket
+import time
+
+from bench_http_requests import ResponseReader
+
+# lwIP defaults from ./sdkconfig
+TCP_MSS = 1440
+TCP_SND_BUF = 2880
+
+# Models the socket's send buffer draining at the link rate
+class SimulatedSocket:
+    def __init__(self, send_buffer_size, link_rate):
+        self.send_buffer_size = send_buffer_size
+        self.link_rate = link_rate
+        self.total_buffered = 0
+        self.last_time = 0.0
+
+    def _drain(self, now):
+        self.total_buffered = max(0.0, self.total_buffered - (now - self.last_time)*self.link_rate)
+        self.last_time = now
+
+    # Non-blocking send, returns the bytes taken
+    def try_send(self, now, length):
+        self._drain(now)
+        total_sent = int(min(length, self.send_buffer_size - self.total_buffered))
+        self.total_buffered += total_sent
+        return total_sent
+
+    # Blocking send, returns the time it returned at
+    def send_all(self, now, length):
+        while length > 0:
+            total_sent = self.try_send(now, length)
+            length -= total_sent
+            if length > 0:
+                # wait until the rest or a full buffer fits
+                needed = min(length, self.send_buffer_size) - (self.send_buffer_size - self.total_buffered)
+                now += max(needed, 1) / self.link_rate
+        return now
+
+    def finish_time(self, now):
+        self._drain(now)
+        return now + self.total_buffered / self.link_rate
+
+class SimulatedFlash:
+    def __init__(self, read_overhead, read_rate):
+        self.read_overhead = read_overhead
+        self.read_rate = read_rate
+
+    def read_time(self, length):
+        return self.read_overhead + length / self.read_rate
+
+# Old path: read a block then send it as a chunk with its hex length line and CRLF
+def simulate_chunked(file_size, block_size, flash, sock):
+    now = 0.0
+    remaining = file_size
+    while remaining > 0:
+        length = min(block_size, remaining)
+        now += flash.read_time(length)
+        now = sock.send_all(now, length + len(f"{length:x}\r\n\r\n"))
+        remaining -= length
+    now = sock.send_all(now, len("0\r\n\r\n"))
+    return sock.finish_time(now)
+
+# Mirrors stream_file_blocks() in components/webserver/src/webserver.c
+def simulate_double_buffered(file_size, block_size, flash, sock):
+    now = 0.0
+    remaining = file_size
+    front = min(block_size, remaining)
+    now += flash.read_time(front)
+    remaining -= front
+    while front > 0:
+        total_sent = 0
+        back = None
+        while total_sent < front:
+            total_sent += sock.try_send(now, front - total_sent)
+            if total_sent == front:
+                break
+            if back is None:
+                back = min(block_size, remaining)
+                now += flash.read_time(back)
+                remaining -= back
+                continue
+            now = sock.send_all(now, front - total_sent)
+            total_sent = front
+        if back is None:
+            back = min(block_size, remaining)
+            now += flash.read_time(back)
+            remaining -= back
+        front = back
+    return sock.finish_time(now)
+
+def run_simulation(args):
+    flash = SimulatedFlash(args.flash_overhead, args.flash_rate)
+    print(f"{'size':>8} {'chunked 512 (ms)':>17} {'double buffered (ms)':>21} {'speedup':>8}")
+    for file_size in args.size:
+        chunked = simulate_chunked(file_size, 512, flash, SimulatedSocket(TCP_SND_BUF, args.link_rate))
+        pipelined = simulate_double_buffered(file_size, args.block_size, flash, SimulatedSocket(TCP_SND_BUF, args.link_rate))
+        print(f"{file_size:>8} {chunked:>17.1f} {pipelined:>21.1f} {chunked/pipelined:>7.2f}x")
+
+def download(args, uri):
+    sock = socket.create_connection((args.host, args.port), timeout=args.timeout)
+    try:
+        request = f"GET {uri} HTTP/1.1\r\nHost: {args.host}\r\nAccept-Encoding: identity\r\nConnection: close\r\n\r\n"
+        reader = ResponseReader(sock)
+        start = time.perf_counter()
+        sock.sendall(request.encode("ascii"))
+        status, headers = reader.read_response()
+        elapsed = time.perf_counter() - start
+    finally:
+        sock.close()
+    return status, int(headers.get("content-length", "0")), elapsed
+
+def run_downloads(args):
+    print(f"{'uri':>24} {'status':>6} {'bytes':>8} {'ms':>8} {'KiB/s':>8}")
+    for uri in args.uri:
+        total_bytes = 0
+        total_elapsed = 0
+        for _ in range(args.count):
+            status, length, elapsed = download(args, uri)
+            total_bytes += length
+            total_elapsed += elapsed
+        rate = total_bytes / 1024 / total_elapsed if total_elapsed > 0 else 0
+        print(f"{uri:>24} {status:>6} {total_bytes//args.count:>8} {total_elapsed/args.count*1000:>8.1f} {rate:>8.1f}")
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure static file download speed from the device, or simulate the streaming pipeline on the host")
+    parser.add_argument("host", type=str, nargs="?", help="Address of the device, not needed with --simulate")
+    parser.add_argument("--port", default=80, type=int, help="HTTP port of the device")
+    parser.add_argument("--uri", action="append", type=str, help="File to download (repeatable, default /favicon.ico)")
+    parser.add_argument("--count", default=10, type=int, help="Downloads per file")
+    parser.add_argument("--timeout", default=10, type=float, help="Socket timeout in seconds")
+    parser.add_argument("--simulate", action="store_true", help="Compare the old and new streaming loops with a simulated flash and socket")
+    parser.add_argument("--size", action="append", type=int, help="Simulated file size in bytes (repeatable)")
+    parser.add_argument("--block-size", default=TCP_MSS, type=int, help="Simulated block size of the double buffered loop")
+    parser.add_argument("--flash-overhead", default=1.0, type=float, help="Simulated milliseconds per spiffs read call")
+    parser.add_argument("--flash-rate", default=1000, type=float, help="Simulated flash read rate in bytes/ms")
+    parser.add_argument("--link-rate", default=500, type=float, help="Simulated rate the socket drains at in bytes/ms")
+    args = parser.parse_args()
+
+    if args.simulate:
+        args.size = args.size or [2048, 16384, 65536, 262144]
+        run_simulation(args)
+        return
+    if args.host is None:
+        parser.error("host is required unless --simulate is given")
+    args.uri = args.uri or ["/favicon.ico"]
+    run_downloads(args)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,250 @@
+import argparse
+import collections
+import random
+import socket
+import time
+
+# Requests as sent by a browser loading the dashboard
+RECORDED_REQUESTS = [
+    (
+        "GET / HTTP/1.1\r\n"
+        "Host: {host}\r\n"
+        "Connection: keep-alive\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+        "Accept-Encoding: gzip, deflate\r\n"
+        "Accept-Language: en-US,en;q=0.9\r\n"
+        "\r\n"
+    ),
+    (
+        "GET /css/index.css HTTP/1.1\r\n"
+        "Host: {host}\r\n"
+        "Connection: keep-alive\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+        "Accept: text/css,*/*;q=0.1\r\n"
+        "Referer: http://{host}/\r\n"
+        "Accept-Encoding: gzip, deflate\r\n"
+        "Accept-Language: en-US,en;q=0.9\r\n"
+        "\r\n"
+    ),
+    (
+        "GET /js/App.js HTTP/1.1\r\n"
+        "Host: {host}\r\n"
+        "Connection: keep-alive\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+        "Accept: */*\r\n"
+        "Referer: http://{host}/\r\n"
+        "Accept-Encoding: gzip, deflate\r\n"
+        "Accept-Language: en-US,en;q=0.9\r\n"
+        "If-None-Match: 0000000000000000000000000000000000000000\r\n"
+        "\r\n"
+    ),
+    (
+        "GET /favicon.ico HTTP/1.1\r\n"
+        "Host: {host}\r\n"
+        "Connection: keep-alive\r\n"
+        "Accept: image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;q=0.8\r\n"
+        "Referer: http://{host}/\r\n"
+        "\r\n"
+    ),
+]
+
+# Split patterns that exercise the 128 byte parser block boundaries
+DEFAULT_PATTERNS = ["whole", "1", "7", "127", "128", "129", "random"]
+
+Result = collections.namedtuple("Result", ["pattern", "requests", "elapsed", "errors"])
+
+def load_requests(args):
+    if not args.request:
+        return [request.format(host=args.host).encode("ascii") for request in RECORDED_REQUESTS]
+    requests = []
+    for filepath in args.request:
+        with open(filepath, "rb") as fp:
+            requests.append(fp.read())
+    return requests
+
+def split_request(data, pattern, rng):
+    if pattern == "whole":
+        return [data]
+    chunks = []
+    offset = 0
+    while offset < len(data):
+        if pattern == "random":
+            size = rng.randint(1, 256)
+        else:
+            size = int(pattern)
+        chunks.append(data[offset:offset+size])
+        offset += size
+    return chunks
+
+def connect(args):
+    sock = socket.create_connection((args.host, args.port), timeout=args.timeout)
+    # Every chunk should leave as its own segment so the parser sees the split
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    return sock
+
+class ResponseReader:
+    def __init__(self, sock):
+        self.sock = sock
+        self.buffer = b""
+
+    def _fill(self):
+        data = self.sock.recv(4096)
+        if not data:
+            raise ConnectionError("connection closed by server")
+        self.buffer += data
+
+    def _read_line(self):
+        while b"\r\n" not in self.buffer:
+            self._fill()
+        line, self.buffer = self.buffer.split(b"\r\n", 1)
+        return line
+
+    def _read_exact(self, length):
+        while len(self.buffer) < length:
+            self._fill()
+        data, self.buffer = self.buffer[:length], self.buffer[length:]
+        return data
+
+    # Returns (status, headers) after consuming the response body
+    def read_response(self):
+        status_line = self._read_line().decode("ascii", "replace")
+        status = int(status_line.split(" ")[1])
+        headers = {}
+        while True:
+            line = self._read_line()
+            if not line:
+                break
+            field, value = line.decode("ascii", "replace").split(":", 1)
+            headers[field.strip().lower()] = value.strip()
+        if headers.get("transfer-encoding", "").lower() == "chunked":
+            while True:
+                size = int(self._read_line().split(b";")[0], 16)
+                self._read_exact(size + 2)
+                if size == 0:
+                    break
+        else:
+            self._read_exact(int(headers.get("content-length", "0")))
+        return status, headers
+
+def run_pattern(args, requests, pattern):
+    rng = random.Random(args.seed)
+    total_requests = 0
+    total_errors = 0
+    sock = None
+    reader = None
+    start = time.perf_counter()
+    while total_requests < args.count:
+        request = requests[total_requests % len(requests)]
+        try:
+            if sock is None:
+                sock = connect(args)
+                reader = ResponseReader(sock)
+            for chunk in split_request(request, pattern, rng):
+                sock.sendall(chunk)
+                if args.gap > 0:
+                    time.sleep(args.gap / 1000)
+            status, headers = reader.read_response()
+            if status >= 500:
+                total_errors += 1
+            if headers.get("connection", "").lower() == "close":
+                sock.close()
+                sock = None
+        except (OSError, ValueError, IndexError) as ex:
+            print(f"[ERROR]: pattern={pattern} request={total_requests} error='{ex}'")
+            total_errors += 1
+            if sock is not None:
+                sock.close()
+            sock = None
+        total_requests += 1
+    elapsed = time.perf_counter() - start
+    if sock is not None:
+        sock.close()
+    return Result(pattern, total_requests, elapsed, total_errors)
+
+def mutate_request(data, rng):
+    data = bytearray(data)
+    for _ in range(rng.randint(1, 8)):
+        action = rng.randint(0, 3)
+        offset = rng.randrange(len(data))
+        if action == 0:
+            data[offset] = rng.randint(0, 255)
+        elif action == 1:
+            data[offset:offset] = bytes(rng.randint(0, 255) for _ in range(rng.randint(1, 64)))
+        elif action == 2:
+            del data[offset:offset+rng.randint(1, 64)]
+        else:
+            # Oversized headers and URIs
+            data[offset:offset] = b"A" * rng.randint(128, 2048)
+        if not data:
+            data = bytearray(b"\r\n")
+    return bytes(data)
+
+def is_server_alive(args, requests):
+    try:
+        sock = connect(args)
+        try:
+            sock.sendall(requests[0])
+            status, _ = ResponseReader(sock).read_response()
+            return status < 500
+        finally:
+            sock.close()
+    except (OSError, ValueError, IndexError):
+        return False
+
+def run_fuzz(args, requests):
+    rng = random.Random(args.seed)
+    total_failures = 0
+    for index in range(args.fuzz):
+        request = mutate_request(rng.choice(requests), rng)
+        pattern = rng.choice(DEFAULT_PATTERNS)
+        try:
+            sock = connect(args)
+            try:
+                for chunk in split_request(request, pattern, rng):
+                    sock.sendall(chunk)
+                # Any response or a close is fine, the server just has to survive
+                sock.settimeout(args.timeout)
+                sock.recv(4096)
+            finally:
+                sock.close()
+        except OSError:
+            pass
+        if is_server_alive(args, requests):
+            continue
+        total_failures += 1
+        filepath = f"fuzz_crash_{index}.bin"
+        with open(filepath, "wb+") as fp:
+            fp.write(request)
+        print(f"[ERROR]: server stopped responding after input {index}, saved to '{filepath}'")
+        time.sleep(args.recover)
+    print(f"Fuzzed {args.fuzz} inputs with {total_failures} failures")
+    return total_failures
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure and fuzz the HTTP request parser of the device over TCP")
+    parser.add_argument("host", type=str, help="Address of the device")
+    parser.add_argument("--port", default=80, type=int, help="HTTP port of the device")
+    parser.add_argument("--request", action="append", type=str, help="File with a raw request to send instead of the recorded ones (repeatable)")
+    parser.add_argument("--pattern", action="append", type=str, help=f"Split pattern: whole, random or a chunk size in bytes (repeatable, default {DEFAULT_PATTERNS})")
+    parser.add_argument("--count", default=200, type=int, help="Number of requests per split pattern")
+    parser.add_argument("--gap", default=0, type=float, help="Delay between chunks of a request in milliseconds")
+    parser.add_argument("--timeout", default=5, type=float, help="Socket timeout in seconds")
+    parser.add_argument("--seed", default=0, type=int, help="Seed for random splits and mutations")
+    parser.add_argument("--fuzz", default=0, type=int, help="Send this many mutated requests instead of measuring throughput")
+    parser.add_argument("--recover", default=10, type=float, help="Seconds to wait for the device to recover after a fuzz failure")
+    args = parser.parse_args()
+
+    requests = load_requests(args)
+    if args.fuzz > 0:
+        exit(1 if run_fuzz(args, requests) > 0 else 0)
+
+    patterns = args.pattern or DEFAULT_PATTERNS
+    print(f"{'pattern':>8} {'requests':>8} {'errors':>6} {'req/s':>8}")
+    for pattern in patterns:
+        result = run_pattern(args, requests, pattern)
+        rate = result.requests / result.elapsed if result.elapsed > 0 else 0
+        print(f"{result.pattern:>8} {result.requests:>8} {result.errors:>6} {rate:>8.1f}")
+
+if __name__ == "__main__":
+    main()
@@ -2,7 +2,7 @@
 BUILD_DIR=./build
 BUILD_OUT=./build-artifact
 APP_NAME=websocket-demo
-SPIFFS_PARTITION="./spiffs_filesystem_partition.bin"
+ASSETS_PARTITION="./server_bundle.bin"
 
 rm -rf $BUILD_OUT
 mkdir $BUILD_OUT
@@ -15,9 +15,9 @@ cp --parents $BUILD_DIR/bootloader/bootloader.map $BUILD_OUT
 cp --parents $BUILD_DIR/partition_table/partition-table.bin $BUILD_OUT
 echo "Copying compiled binaries"
 
-cp $SPIFFS_PARTITION $BUILD_OUT/$SPIFFS_PARTITION
+cp $ASSETS_PARTITION $BUILD_OUT/$ASSETS_PARTITION
 cp ./partitions.csv $BUILD_OUT/partitions.csv
-echo "Copying SPIFFS filesystem image"
+echo "Copying static webserver bundle"
 
 cp -rf ./scripts $BUILD_OUT/scripts
 echo "Copying scripts"
@@ -0,0 +1,198 @@
+import argparse
+import collections
+import gzip
+import hashlib
+import os
+import struct
+
+# Layout must match components/webserver/src/asset_bundle.h
+BUNDLE_MAGIC = 0x31425341 # "ASB1"
+BUNDLE_VERSION = 2
+BUNDLE_ALIGNMENT = 4
+HEADER_FORMAT = "<IHHIII"
+ENTRY_FORMAT = "<IIIIIBBH20s"
+MAX_PATH_LENGTH = 64
+# cache for 1 week, always check if etag matches
+CACHE_CONTROL = "max-age=604800, public, no-cache"
+
+# Index of each mimetype is its id on the device
+MIMETYPE_IDS = [
+    "application/octet-stream",
+    "text/html",
+    "application/javascript",
+    "text/css",
+    "image/x-icon",
+    "application/json",
+    "image/png",
+    "image/svg+xml",
+    "text/plain",
+]
+
+ENCODING_IDENTITY = 0
+ENCODING_GZIP = 1
+
+DEFAULT_MIMETYPE = "application/octet-stream"
+MIMETYPES = {
+    "bin": "application/octet-stream",
+    "js": "application/javascript",
+    "html": "text/html",
+    "css": "text/css",
+    "ico": "image/x-icon",
+}
+
+# Text files shrink a lot, skip variants that barely save anything
+GZIP_MIN_SAVING = 0.1
+
+BundleEntry = collections.namedtuple("BundleEntry", ["path", "path_hash", "encoding", "mime_id", "data"])
+
+def get_paths_recursive(root_path):
+    for filename in os.listdir(root_path):
+        filepath = os.path.join(root_path, filename)
+        if os.path.isdir(filepath):
+            for path in get_paths_recursive(filepath):
+                yield path
+        elif os.path.isfile(filepath):
+            yield filepath
+        else:
+            print(f"Ignoring '{filepath}'")
+
+def get_mime_type(filepath):
+    _, ext = os.path.splitext(filepath)
+    if len(ext) <= 1:
+        return DEFAULT_MIMETYPE
+    ext = ext[1:]
+    return MIMETYPES.get(ext, DEFAULT_MIMETYPE)
+
+def is_gzip_variant(filepath):
+    base_filepath, ext = os.path.splitext(filepath)
+    return ext == ".gz" and os.path.isfile(base_filepath)
+
+def hash_path(path):
+    # 32bit FNV-1a
+    value = 0x811C9DC5
+    for byte in path.encode("utf-8"):
+        value ^= byte
+        value = (value * 0x01000193) & 0xFFFFFFFF
+    return value
+
+def align(offset):
+    return (offset + BUNDLE_ALIGNMENT - 1) & ~(BUNDLE_ALIGNMENT - 1)
+
+# Header lines that don't change between requests, sent as is by the device
+def render_headers(entry, sha1, has_gzip):
+    lines = [
+        f"ETag: \"{sha1.hex()}\"",
+        f"Cache-Control: {CACHE_CONTROL}",
+        "Accept-Ranges: bytes",
+    ]
+    # each variant has its own etag so caches don't mix up encodings
+    if has_gzip:
+        lines.append("Vary: Accept-Encoding")
+    if entry.encoding == ENCODING_GZIP:
+        lines.append("Content-Encoding: gzip")
+    return "".join(f"{line}\r\n" for line in lines).encode("ascii")
+
+def load_entries(static_dir, use_gzip):
+    entries = []
+    for filepath in get_paths_recursive(static_dir):
+        # leftovers from the spiffs index are regenerated instead of bundled
+        if is_gzip_variant(filepath) or os.path.basename(filepath) == "server_files.csv":
+            continue
+        path = "/" + os.path.relpath(filepath, static_dir).replace("\\", "/")
+        if len(path) >= MAX_PATH_LENGTH:
+            print(f"[ERROR]: Skipping '{filepath}' since its path is longer than {MAX_PATH_LENGTH-1} characters")
+            continue
+        with open(filepath, "rb") as fp:
+            data = fp.read()
+        mime_type = get_mime_type(filepath)
+        if mime_type not in MIMETYPE_IDS:
+            print(f"[WARN]: '{filepath}' has no mimetype id for '{mime_type}', using '{MIMETYPE_IDS[0]}'")
+            mime_type = MIMETYPE_IDS[0]
+        mime_id = MIMETYPE_IDS.index(mime_type)
+        path_hash = hash_path(path)
+        entries.append(BundleEntry(path, path_hash, ENCODING_IDENTITY, mime_id, data))
+        if not use_gzip:
+            continue
+        # mtime=0 so the output and its hash only change with the content
+        gzip_data = gzip.compress(data, compresslevel=9, mtime=0)
+        if len(gzip_data) <= len(data)*(1-GZIP_MIN_SAVING):
+            entries.append(BundleEntry(path, path_hash, ENCODING_GZIP, mime_id, gzip_data))
+    # sorted by hash so the device can binary search, variants of a path end up next to each other
+    entries.sort(key=lambda entry: (entry.path_hash, entry.path, entry.encoding))
+    return entries
+
+def create_bundle(entries):
+    header_size = struct.calcsize(HEADER_FORMAT)
+    entry_size = struct.calcsize(ENTRY_FORMAT)
+    strings_offset = header_size + entry_size*len(entries)
+
+    # paths are stored once for all variants
+    path_offsets = {}
+    strings = bytearray()
+    for entry in entries:
+        if entry.path in path_offsets:
+            continue
+        path_offsets[entry.path] = strings_offset + len(strings)
+        strings += entry.path.encode("utf-8") + b"\0"
+
+    # header blocks follow the paths, the device loads everything up to index_size into RAM at boot
+    gzip_paths = { entry.path for entry in entries if entry.encoding == ENCODING_GZIP }
+    sha1s = [hashlib.sha1(entry.data).digest() for entry in entries]
+    header_ranges = []
+    headers = bytearray()
+    for entry, sha1 in zip(entries, sha1s):
+        block = render_headers(entry, sha1, entry.path in gzip_paths)
+        header_ranges.append((strings_offset + len(strings) + len(headers), len(block)))
+        headers += block
+    index_size = strings_offset + len(strings) + len(headers)
+
+    data_offset = align(index_size)
+    data = bytearray()
+    table = bytearray()
+    for entry, sha1, (header_offset, header_length) in zip(entries, sha1s, header_ranges):
+        offset = data_offset + len(data)
+        data += entry.data
+        data += b"\0" * (align(len(data)) - len(data))
+        table += struct.pack(
+            ENTRY_FORMAT,
+            entry.path_hash, path_offsets[entry.path], offset, len(entry.data),
+            header_offset, entry.mime_id, entry.encoding, header_length, sha1,
+        )
+
+    total_size = data_offset + len(data)
+    header = struct.pack(HEADER_FORMAT, BUNDLE_MAGIC, BUNDLE_VERSION, len(entries), strings_offset, index_size, total_size)
+    padding = b"\0" * (data_offset - index_size)
+    return header + table + strings + headers + padding + data
+
+def main():
+    parser = argparse.ArgumentParser(description="Pack the website files into a single bundle for the assets partition")
+    parser.add_argument("--static", default="./static", type=str, help="Directory of website files")
+    parser.add_argument("--output", default="./server_bundle.bin", type=str, help="Filepath of the bundle")
+    parser.add_argument("--partition-size", default=1048576, type=int, help="Size of the assets partition in ./partitions.csv")
+    parser.add_argument("--no-gzip", action="store_true", help="Don't add gzip variants of the website files")
+    args = parser.parse_args()
+
+    entries = load_entries(args.static, not args.no_gzip)
+    hashes = {}
+    for entry in entries:
+        if hashes.setdefault(entry.path_hash, entry.path) != entry.path:
+            print(f"[ERROR]: '{entry.path}' and '{hashes[entry.path_hash]}' have the same path hash, rename one of them")
+            exit(1)
+
+    bundle = create_bundle(entries)
+    if len(bundle) > args.partition_size:
+        print(f"[ERROR]: Bundle is {len(bundle)} bytes but the partition only has {args.partition_size} bytes")
+        exit(1)
+
+    print(f"Bundling {len(entries)} entries")
+    for index, entry in enumerate(entries):
+        encoding = "gzip" if entry.encoding == ENCODING_GZIP else "identity"
+        print(f"{index}: path='{entry.path}',size={len(entry.data)},mime_type='{MIMETYPE_IDS[entry.mime_id]}',encoding={encoding},path_hash={entry.path_hash:08x}")
+    index_size = struct.unpack_from(HEADER_FORMAT, bundle)[4]
+    print(f"Total bundle size {len(bundle)} bytes with a {index_size} byte index")
+
+    with open(args.output, "wb+") as fp:
+        fp.write(bundle)
+
+if __name__ == "__main__":
+    main()
@@ -1,7 +1,6 @@
 #!/bin/sh
 BUILD_DIR=./build
 APP_NAME=websocket-demo
-SPIFFS_PARTITION="./spiffs_filesystem_partition.bin"
 
 # NOTE: Refer to the datasheet for your specific version of the ESP8266 for the correct flash size
 # flash size for the ESP8266-12E
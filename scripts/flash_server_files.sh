@@ -1,5 +1,5 @@
 #!/bin/sh
-OUTPUT_FILE="./spiffs_filesystem_partition.bin"
+OUTPUT_FILE="./server_bundle.bin"
 # flash size for the ESP8266-12E
 FLASH_SIZE="4MB"
 
@@ -0,0 +1,157 @@
+import argparse
+import json
+import queue
+import struct
+import threading
+import time
+
+from websocket_client import WebsocketClient, OPCODE_BINARY, OPCODE_CLOSE
+
+# Layout of the stats reply from main/websocket_handler.c
+STATS_CMD = 0x04
+STATS_FIELDS = [
+    "free_heap", "min_free_heap",
+    "ws_rx_frames", "ws_rx_bytes", "ws_tx_frames", "ws_tx_bytes", "ws_task_pool_peak",
+    "accepted_conns", "shed_conns", "lru_purged_conns", "idle_closed_conns",
+    "ws_tx_drops", "ws_queue_drops", "ws_stale_tasks", "ws_coalesced",
+    "verified_assets", "unhealthy_assets", "asset_hash_bytes_per_ms",
+    "ws_broadcast_pool_peak",
+    "asset_cache_hits", "asset_cache_misses", "asset_cache_evictions",
+]
+
+# Command ids used by the dashboard, see static/js/common.js
+COMMAND_FILTERS = {
+    "all": lambda data: True,
+    "led": lambda data: data[0] == 0x01,
+    "led_set": lambda data: data[0] == 0x01 and len(data) > 1 and data[1] == 0x01,
+    "pc": lambda data: data[0] == 0x02,
+    "dht11": lambda data: data[0] == 0x03,
+}
+
+def load_trace(filepath, command_filter):
+    with open(filepath, "r") as fp:
+        trace = json.load(fp)
+    if trace.get("version") != 1:
+        raise ValueError(f"unsupported trace version: {trace.get('version')}")
+    frames = []
+    for frame in trace["frames"]:
+        if frame["direction"] != "tx":
+            continue
+        data = bytes.fromhex(frame["data"])
+        if len(data) == 0 or not command_filter(data):
+            continue
+        frames.append((frame["time_ms"], data))
+    return frames
+
+def decode_stats(payload):
+    total_values = payload[1]
+    values = struct.unpack(f"<{total_values}I", payload[2:2+total_values*4])
+    stats = dict(zip(STATS_FIELDS, values))
+    stats["reply_size"] = 2 + total_values*4
+    return stats
+
+class FrameReader(threading.Thread):
+    def __init__(self, client):
+        super().__init__(daemon=True)
+        self.client = client
+        self.stats_replies = queue.Queue()
+        self.total_frames = 0
+        self.total_bytes = 0
+        self.error = None
+
+    def run(self):
+        try:
+            while True:
+                opcode, payload = self.client.recv_frame()
+                if opcode == OPCODE_CLOSE:
+                    break
+                if opcode != OPCODE_BINARY or len(payload) == 0:
+                    continue
+                if payload[0] == STATS_CMD:
+                    self.stats_replies.put(decode_stats(payload))
+                    continue
+                self.total_frames += 1
+                self.total_bytes += len(payload)
+        except (OSError, ConnectionError) as ex:
+            self.error = ex
+        self.stats_replies.put(None)
+
+def request_stats(client, reader, timeout):
+    client.send_binary(bytes([STATS_CMD]))
+    stats = reader.stats_replies.get(timeout=timeout)
+    if stats is None:
+        raise ConnectionError(f"connection lost while waiting for stats: {reader.error}")
+    return stats
+
+def replay(args, client, frames):
+    start = time.perf_counter()
+    if args.realtime:
+        trace_start = frames[0][0]
+        for time_ms, data in frames:
+            delay = (time_ms - trace_start) / 1000 - (time.perf_counter() - start)
+            if delay > 0:
+                time.sleep(delay)
+            client.send_binary(data)
+    elif args.batch > 1:
+        for i in range(0, len(frames), args.batch):
+            client.send_binary_many([data for _, data in frames[i:i+args.batch]])
+    else:
+        for _, data in frames:
+            client.send_binary(data)
+    return start
+
+def main():
+    parser = argparse.ArgumentParser(description="Replay a websocket trace recorded from the dashboard and measure device throughput")
+    parser.add_argument("host", type=str, help="Address of the device")
+    parser.add_argument("trace", type=str, help="Trace file saved from the dashboard")
+    parser.add_argument("--port", default=80, type=int, help="HTTP port of the device")
+    parser.add_argument("--uri", default="/api/v1/websocket", type=str, help="Websocket endpoint")
+    parser.add_argument("--filter", default="all", choices=COMMAND_FILTERS.keys(), help="Only replay these commands")
+    parser.add_argument("--repeat", default=1, type=int, help="Replay the trace this many times")
+    parser.add_argument("--realtime", action="store_true", help="Keep the recorded timing instead of sending as fast as possible")
+    parser.add_argument("--batch", default=1, type=int, help="Frames to coalesce into a single write when not in realtime")
+    parser.add_argument("--timeout", default=30, type=float, help="Seconds to wait for the device to catch up")
+    args = parser.parse_args()
+
+    frames = load_trace(args.trace, COMMAND_FILTERS[args.filter])
+    if len(frames) == 0:
+        print(f"[ERROR]: no frames to replay in '{args.trace}' with filter '{args.filter}'")
+        exit(1)
+    frames = frames * args.repeat
+
+    client = WebsocketClient(args.host, args.port, args.uri, timeout=args.timeout)
+    reader = FrameReader(client)
+    reader.start()
+    try:
+        before = request_stats(client, reader, args.timeout)
+        rx_frames_before = reader.total_frames
+        rx_bytes_before = reader.total_bytes
+        start = replay(args, client, frames)
+        # the device handles frames of a connection in order so the stats reply marks the end of the replay
+        after = request_stats(client, reader, args.timeout)
+        elapsed = time.perf_counter() - start
+    finally:
+        client.close()
+
+    delta = { key: after[key] - before[key] for key in STATS_FIELDS if key in after and key in before }
+    total_frames = len(frames)
+    # exclude the stats request and reply that closes the measurement
+    device_rx_frames = delta["ws_rx_frames"] - 1
+    device_tx_frames = delta["ws_tx_frames"] - 1
+    device_tx_bytes = delta["ws_tx_bytes"] - before["reply_size"]
+
+    print(f"Replayed {total_frames} frames in {elapsed:.3f}s")
+    print(f"  frames/sec:              {total_frames/elapsed:.1f}")
+    print(f"  device received frames:  {device_rx_frames}")
+    print(f"  device sent frames:      {device_tx_frames}")
+    print(f"  device sent bytes/frame: {device_tx_bytes/total_frames:.2f}")
+    print(f"  device pool peak:        {after['ws_task_pool_peak']} tasks, {after.get('ws_broadcast_pool_peak', 0)} broadcasts")
+    print(f"  device dropped frames:   {delta.get('ws_tx_drops', 0)} (queue full {delta.get('ws_queue_drops', 0)})")
+    print(f"  client received frames:  {reader.total_frames - rx_frames_before}")
+    print(f"  client received bytes:   {reader.total_bytes - rx_bytes_before}")
+    print(f"  free heap:               {before['free_heap']} -> {after['free_heap']} (min {after['min_free_heap']})")
+    if device_rx_frames != total_frames:
+        print(f"[WARN]: device received {device_rx_frames} frames but {total_frames} were sent")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,95 @@
+import argparse
+import random
+import socket
+import struct
+import threading
+import time
+
+from websocket_client import WebsocketClient, OPCODE_BINARY
+from replay_websocket_trace import STATS_CMD, decode_stats
+
+# Commands that queue async work on the device, see main/websocket_handler.c
+DHT11_REQUEST = bytes([0x03])
+SUBSCRIBE_ALL = [bytes([0x05, 0x01, topic]) for topic in range(4)]
+
+def request_stats(client):
+    client.send_binary(bytes([STATS_CMD]))
+    while True:
+        opcode, payload = client.recv_frame()
+        if opcode == OPCODE_BINARY and len(payload) > 0 and payload[0] == STATS_CMD:
+            return decode_stats(payload)
+
+def close_abruptly(client):
+    # RST instead of a close frame so the device has to notice the socket error by itself
+    client.sock.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack("ii", 1, 0))
+    client.sock.close()
+
+class ChurnWorker(threading.Thread):
+    def __init__(self, args, index):
+        super().__init__(daemon=True)
+        self.args = args
+        self.rng = random.Random(args.seed + index)
+        self.total_opened = 0
+        self.total_failed = 0
+
+    def run(self):
+        for _ in range(self.args.iterations):
+            try:
+                client = WebsocketClient(self.args.host, self.args.port, self.args.uri, timeout=self.args.timeout)
+            except (OSError, ConnectionError):
+                # the server sheds connections when every socket is busy
+                self.total_failed += 1
+                time.sleep(0.1)
+                continue
+            self.total_opened += 1
+            try:
+                # queue async work and leave before it has a chance to run
+                client.send_binary_many(SUBSCRIBE_ALL + [DHT11_REQUEST] * self.rng.randint(1, 4))
+                if self.rng.random() < 0.5:
+                    close_abruptly(client)
+                else:
+                    client.close()
+            except OSError:
+                self.total_failed += 1
+            time.sleep(self.rng.uniform(0, self.args.delay / 1000))
+
+def main():
+    parser = argparse.ArgumentParser(description="Open and close websocket clients while their async tasks are in flight")
+    parser.add_argument("host", type=str, help="Address of the device")
+    parser.add_argument("--port", default=80, type=int, help="HTTP port of the device")
+    parser.add_argument("--uri", default="/api/v1/websocket", type=str, help="Websocket endpoint")
+    parser.add_argument("--workers", default=3, type=int, help="Concurrent churning clients")
+    parser.add_argument("--iterations", default=100, type=int, help="Connections opened by each worker")
+    parser.add_argument("--delay", default=50, type=float, help="Maximum delay between connections in milliseconds")
+    parser.add_argument("--timeout", default=5, type=float, help="Socket timeout in seconds")
+    parser.add_argument("--seed", default=0, type=int, help="Seed for random close modes and delays")
+    args = parser.parse_args()
+
+    # a long lived client checks the device is still serving after the churn
+    monitor = WebsocketClient(args.host, args.port, args.uri, timeout=args.timeout)
+    before = request_stats(monitor)
+
+    workers = [ChurnWorker(args, i) for i in range(args.workers)]
+    start = time.perf_counter()
+    for worker in workers:
+        worker.start()
+    for worker in workers:
+        worker.join()
+    elapsed = time.perf_counter() - start
+
+    # give queued work and closes time to settle
+    time.sleep(1)
+    after = request_stats(monitor)
+    monitor.close()
+
+    total_opened = sum(worker.total_opened for worker in workers)
+    total_failed = sum(worker.total_failed for worker in workers)
+    print(f"Opened {total_opened} clients in {elapsed:.1f}s with {total_failed} failures")
+    print(f"  stale async tasks skipped: {after.get('ws_stale_tasks', 0) - before.get('ws_stale_tasks', 0)}")
+    print(f"  queued work dropped:       {after.get('ws_queue_drops', 0) - before.get('ws_queue_drops', 0)}")
+    print(f"  queued work pool peak:     {after['ws_task_pool_peak']} tasks, {after.get('ws_broadcast_pool_peak', 0)} broadcasts")
+    print(f"  shed connections:          {after['shed_conns'] - before['shed_conns']}")
+    print(f"  free heap:                 {before['free_heap']} -> {after['free_heap']} (min {after['min_free_heap']})")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,101 @@
+import base64
+import os
+import socket
+import struct
+
+# Minimal blocking websocket client for the helper scripts
+OPCODE_CONTINUATION = 0x0
+OPCODE_TEXT = 0x1
+OPCODE_BINARY = 0x2
+OPCODE_CLOSE = 0x8
+OPCODE_PING = 0x9
+OPCODE_PONG = 0xA
+
+class WebsocketClient:
+    def __init__(self, host, port, uri, timeout=5):
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.buffer = b""
+        self._handshake(host, port, uri)
+
+    def _handshake(self, host, port, uri):
+        key = base64.b64encode(os.urandom(16)).decode("ascii")
+        request = (
+            f"GET {uri} HTTP/1.1\r\n"
+            f"Host: {host}:{port}\r\n"
+            "Upgrade: websocket\r\n"
+            "Connection: Upgrade\r\n"
+            f"Sec-WebSocket-Key: {key}\r\n"
+            "Sec-WebSocket-Version: 13\r\n"
+            "\r\n"
+        )
+        self.sock.sendall(request.encode("ascii"))
+        while b"\r\n\r\n" not in self.buffer:
+            self._fill()
+        header, self.buffer = self.buffer.split(b"\r\n\r\n", 1)
+        status_line = header.split(b"\r\n", 1)[0].decode("ascii", "replace")
+        if " 101 " not in status_line:
+            raise ConnectionError(f"websocket handshake failed: '{status_line}'")
+
+    def _fill(self):
+        data = self.sock.recv(4096)
+        if not data:
+            raise ConnectionError("connection closed by server")
+        self.buffer += data
+
+    def _read_exact(self, length):
+        while len(self.buffer) < length:
+            self._fill()
+        data, self.buffer = self.buffer[:length], self.buffer[length:]
+        return data
+
+    def encode_frame(self, opcode, payload):
+        header = bytearray([0x80 | opcode])
+        length = len(payload)
+        if length < 126:
+            header.append(0x80 | length)
+        elif length < (1 << 16):
+            header.append(0x80 | 126)
+            header += struct.pack(">H", length)
+        else:
+            header.append(0x80 | 127)
+            header += struct.pack(">Q", length)
+        # client frames are always masked
+        mask = os.urandom(4)
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+        return bytes(header) + mask + masked
+
+    def send_binary(self, payload):
+        self.sock.sendall(self.encode_frame(OPCODE_BINARY, payload))
+
+    # Sends several frames in one write
+    def send_binary_many(self, payloads):
+        self.sock.sendall(b"".join(self.encode_frame(OPCODE_BINARY, payload) for payload in payloads))
+
+    # Returns (opcode, payload) of the next data or close frame, answering pings
+    def recv_frame(self):
+        while True:
+            first, second = self._read_exact(2)
+            opcode = first & 0x0F
+            length = second & 0x7F
+            if length == 126:
+                length = struct.unpack(">H", self._read_exact(2))[0]
+            elif length == 127:
+                length = struct.unpack(">Q", self._read_exact(8))[0]
+            mask = self._read_exact(4) if second & 0x80 else None
+            payload = self._read_exact(length)
+            if mask is not None:
+                payload = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+            if opcode == OPCODE_PING:
+                self.sock.sendall(self.encode_frame(OPCODE_PONG, payload))
+                continue
+            if opcode == OPCODE_PONG:
+                continue
+            return opcode, payload
+
+    def close(self):
+        try:
+            self.sock.sendall(self.encode_frame(OPCODE_CLOSE, b""))
+        except OSError:
+            pass
+        self.sock.close()
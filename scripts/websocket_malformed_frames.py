@@ -0,0 +1,73 @@
+import argparse
+import os
+import socket
+import struct
+
+from websocket_client import WebsocketClient, OPCODE_BINARY
+from websocket_churn import request_stats
+
+# Frame headers with lengths the device has to reject, the payload that follows never arrives
+# Each one is sent on a fresh connection which the device should close
+def encode_header(length_field, extended_length):
+    header = bytes([0x80 | OPCODE_BINARY, 0x80 | length_field]) + extended_length
+    return header + os.urandom(4)
+
+MALFORMED_FRAMES = {
+    # wraps hdr_len + payload_len to a small number if added unchecked
+    "wrapping_length": encode_header(127, struct.pack(">Q", 0xFFFFFFFFFFFFFFF8)),
+    # most significant bit of a 64 bit length must be 0
+    "msb_set": encode_header(127, struct.pack(">Q", 0x8000000000000010)),
+    # valid length that doesn't fit the scratch buffer
+    "oversized_64bit": encode_header(127, struct.pack(">Q", 1 << 20)),
+    "oversized_16bit": encode_header(126, struct.pack(">H", 0xFFFF)),
+}
+
+def is_closed_by_device(client, timeout):
+    client.sock.settimeout(timeout)
+    try:
+        while True:
+            if not client.sock.recv(4096):
+                return True
+    except ConnectionError:
+        return True
+    except socket.timeout:
+        return False
+
+def main():
+    parser = argparse.ArgumentParser(description="Check the device closes websocket sessions that send invalid frame lengths")
+    parser.add_argument("host", type=str, help="Address of the device")
+    parser.add_argument("--port", default=80, type=int, help="HTTP port of the device")
+    parser.add_argument("--uri", default="/api/v1/websocket", type=str, help="Websocket endpoint")
+    parser.add_argument("--timeout", default=5, type=float, help="Seconds to wait for the device to close the session")
+    args = parser.parse_args()
+
+    # a long lived client checks the device keeps serving after every frame
+    monitor = WebsocketClient(args.host, args.port, args.uri, timeout=args.timeout)
+    before = request_stats(monitor)
+
+    stats = before
+    total_failed = 0
+    for name, frame in MALFORMED_FRAMES.items():
+        client = WebsocketClient(args.host, args.port, args.uri, timeout=args.timeout)
+        client.sock.sendall(frame)
+        is_closed = is_closed_by_device(client, args.timeout)
+        client.sock.close()
+        try:
+            stats = request_stats(monitor)
+            is_alive = True
+        except (OSError, ConnectionError):
+            is_alive = False
+        is_passed = is_closed and is_alive
+        total_failed += 0 if is_passed else 1
+        print(f"{name:>16}: {'PASS' if is_passed else 'FAIL'} (closed={is_closed}, alive={is_alive})")
+        if not is_alive:
+            break
+
+    monitor.close()
+    print(f"  free heap: {before['free_heap']} -> {stats['free_heap']} (min {stats['min_free_heap']})")
+    if total_failed > 0:
+        print(f"[ERROR]: {total_failed} malformed frames weren't rejected")
+        exit(1)
+
+if __name__ == "__main__":
+    main()
@@ -7,13 +7,45 @@ class App {
         this.ws_heartbeat_id = null;
         this.ws_is_updating = false;
         this.on_connection_change = new Set();
+        this.trace = null; // { start_time, frames } while recording
 
         this.packet_decoder = new PacketDecoder();
     }
 
+    // trace methods
+    start_trace = () => {
+        this.trace = {
+            start_time: performance.now(),
+            frames: [],
+        };
+    }
+
+    // returns the recorded trace in the format read by scripts/replay_websocket_trace.py
+    stop_trace = () => {
+        if (this.trace === null) return null;
+        let trace = {
+            version: 1,
+            url: this.ws_url,
+            frames: this.trace.frames,
+        };
+        this.trace = null;
+        return trace;
+    }
+
+    record_trace_frame = (direction, data) => {
+        if (this.trace === null) return;
+        let hex = Array.from(data, (x) => x.toString(16).padStart(2, "0")).join("");
+        this.trace.frames.push({
+            time_ms: Math.round(performance.now() - this.trace.start_time),
+            direction: direction,
+            data: hex,
+        });
+    }
+
     send_ws_data = (data) => {
         if (this.ws === null) return;
         if (this.ws.readyState !== WebSocket.OPEN) return;
+        this.record_trace_frame("tx", data);
         this.ws.send(data);
     }
 
@@ -57,7 +89,9 @@ class App {
         this.ws.onmessage = (ev) => {
             let packet = ev.data;
             if (packet instanceof ArrayBuffer) {
-                this.packet_decoder.on_packet(new Uint8Array(packet));
+                let data = new Uint8Array(packet);
+                this.record_trace_frame("rx", data);
+                this.packet_decoder.on_packet(data);
             } else {
                 // TODO:
             }
@@ -5,12 +5,16 @@ class PacketDecoder {
         this.on_led_reading = new Set(); // (values: Uint8Array) => {}
         this.on_pc_status = new Set();  // (is_on) => {}
         this.on_pc_cmd_result = new Set(); // (command, code) => {}
+        this.on_stats = new Set(); // (values: Uint32Array) => {}
+        this.on_subscribe_result = new Set(); // (op, topic, is_success) => {}
     }
 
     on_packet = (packet) => {
         const LED_ID = 1;
         const PC_ID = 2;
         const DHT11_ID = 3;
+        const STATS_ID = 4;
+        const SUBSCRIBE_ID = 5;
 
         if (packet.length < 1) {
             console.error(`Unknown packet: ${packet}`);
@@ -23,6 +27,8 @@ class PacketDecoder {
         case LED_ID:   this._on_led(data); break;
         case PC_ID:    this._on_pc_controls(data); break;
         case DHT11_ID: this._on_dht11(data); break;
+        case STATS_ID: this._on_stats(data); break;
+        case SUBSCRIBE_ID: this._on_subscribe(data); break;
         default:
             console.error(`Unknown packet id=${id}, data=${data}`);
             break;
@@ -113,6 +119,40 @@ class PacketDecoder {
         }
         console.error(`Unknown DHT11 packet, data=${data}`);
     }
+
+    _on_subscribe = (data) => {
+        if (data.length !== 3) {
+            console.error(`Unknown subscribe packet, data=${data}`);
+            return;
+        }
+        let op = data[0];
+        let topic = data[1];
+        let is_success = data[2] === 1;
+        for (let listener of this.on_subscribe_result) {
+            listener(op, topic, is_success);
+        }
+    }
+
+    _on_stats = (data) => {
+        if (data.length < 1) {
+            console.error(`Insufficient stats packet length data=${data}`);
+            return;
+        }
+        let total_values = data[0];
+        let total_packet_length = 1 + total_values*4;
+        if (data.length !== total_packet_length) {
+            console.error(`Mismatch between expected (${total_packet_length}) and actual (${data.length}) packet length`);
+            return;
+        }
+        let view = new DataView(data.buffer, data.byteOffset+1, total_values*4);
+        let values = new Uint32Array(total_values);
+        for (let i = 0; i < total_values; i++) {
+            values[i] = view.getUint32(i*4, true);
+        }
+        for (let listener of this.on_stats) {
+            listener(values);
+        }
+    }
 }
 
 export { PacketDecoder };
@@ -9,6 +9,8 @@ for (const url of LOCALHOST_URLS) {
     }
 }
 let DEFAULT_WS_URL = `ws://${DEFAULT_HOST_URL}/api/v1/websocket`;
+// Tools for benchmarking are only shown when the page is opened with ?debug
+const IS_DEBUG = new URLSearchParams(document.location.search).has("debug");
 
 let bind_connect_button = (app) => {
     let button_elem = document.getElementById("ws_button");
@@ -225,11 +227,76 @@ let bind_pc_controls = (app) => {
     });
 }
 
+let bind_subscriptions = (app) => {
+    const SUBSCRIBE_ID = 5;
+    const SUBSCRIBE_ADD = 1;
+    // topic ids shared with main/websocket_handler.c
+    const TOPIC_PC_STATUS = 0;
+    const TOPIC_DHT11 = 1;
+    const TOPIC_LED_STATE = 2;
+
+    app.packet_decoder.on_subscribe_result.add((op, topic, is_success) => {
+        if (!is_success) {
+            console.error(`Subscribe op=${op} failed for topic=${topic}`);
+        }
+    });
+
+    app.on_connection_change.add((state) => {
+        if (state == WebSocket.OPEN) {
+            for (let topic of [TOPIC_PC_STATUS, TOPIC_DHT11, TOPIC_LED_STATE]) {
+                app.send_ws_data(new Uint8Array([SUBSCRIBE_ID, SUBSCRIBE_ADD, topic]));
+            }
+        }
+    });
+}
+
+let bind_trace = (app) => {
+    if (!IS_DEBUG) return;
+    document.getElementById("trace_controls").hidden = false;
+    let button_record_elem = document.getElementById("trace_record");
+    let button_save_elem = document.getElementById("trace_save");
+    let text_status_elem = document.getElementById("trace_status");
+    let status_timer_id = null;
+
+    let update_status = () => {
+        let total_frames = (app.trace === null) ? 0 : app.trace.frames.length;
+        text_status_elem.innerText = `Frames: ${total_frames}`;
+    };
+
+    button_record_elem.addEventListener("click", (ev) => {
+        ev.preventDefault();
+        app.start_trace();
+        button_record_elem.disabled = true;
+        button_save_elem.disabled = false;
+        status_timer_id = setInterval(update_status, 500);
+    });
+
+    button_save_elem.addEventListener("click", (ev) => {
+        ev.preventDefault();
+        clearInterval(status_timer_id);
+        status_timer_id = null;
+        let trace = app.stop_trace();
+        button_record_elem.disabled = false;
+        button_save_elem.disabled = true;
+        if (trace === null) return;
+        text_status_elem.innerText = `Frames: ${trace.frames.length}`;
+
+        let blob = new Blob([JSON.stringify(trace, null, 1)], { type: "application/json" });
+        let link = document.createElement("a");
+        link.href = URL.createObjectURL(blob);
+        link.download = "websocket_trace.json";
+        link.click();
+        URL.revokeObjectURL(link.href);
+    });
+}
+
 let bind_app = (app) => {
     bind_connect_button(app);
     bind_dht11(app);
     bind_led_controls(app);
     bind_pc_controls(app);
+    bind_subscriptions(app);
+    bind_trace(app);
     app.notify_ws_state(WebSocket.CLOSED);
     app.open_websocket(DEFAULT_WS_URL);
 }